@@ -33,7 +33,9 @@ Config::Config() :
 	OutputVideoStreamId(1),
 	OutputAudioStreamId(2),
 	OutputVideoSampling(kCdiAvmVidYCbCr422),
-	OutputBitDepth(kCdiAvmVidBitDepth10)
+	OutputBitDepth(kCdiAvmVidBitDepth10),
+	AdapterIdleTimeoutSec(DEFAULT_ADAPTER_IDLE_TIMEOUT_SEC),
+	AdapterTxBufferMB(DEFAULT_ADAPTER_TX_BUFFER_MB)
 {
 	config_t* obs_config = obs_frontend_get_global_config();
 	if (obs_config) {
@@ -47,6 +49,8 @@ Config::Config() :
 		config_set_default_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_VIDEO_SAMPLING, (int)kCdiAvmVidYCbCr422);
 		config_set_default_bool(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_ALPHA_USED, false);
 		config_set_default_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_BIT_DEPTH, (int)kCdiAvmVidBitDepth10);
+		config_set_default_int(obs_config, SECTION_NAME, PARAM_ADAPTER_IDLE_TIMEOUT, AdapterIdleTimeoutSec);
+		config_set_default_int(obs_config, SECTION_NAME, PARAM_ADAPTER_TX_BUFFER, AdapterTxBufferMB);
 	}
 }
 
@@ -63,6 +67,8 @@ void Config::Load() {
 		OutputVideoSampling = (CdiAvmVideoSampling)config_get_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_VIDEO_SAMPLING);
 		OutputAlphaUsed = config_get_bool(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_ALPHA_USED);
 		OutputBitDepth = (CdiAvmVideoBitDepth)config_get_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_BIT_DEPTH);
+		AdapterIdleTimeoutSec = (int)config_get_int(obs_config, SECTION_NAME, PARAM_ADAPTER_IDLE_TIMEOUT);
+		AdapterTxBufferMB = (int)config_get_int(obs_config, SECTION_NAME, PARAM_ADAPTER_TX_BUFFER);
 	}
 }
 
@@ -79,6 +85,8 @@ void Config::Save() {
 		config_set_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_VIDEO_SAMPLING, (int)OutputVideoSampling);
 		config_set_bool(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_ALPHA_USED, OutputAlphaUsed);
 		config_set_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_BIT_DEPTH, (int)OutputBitDepth);
+		config_set_int(obs_config, SECTION_NAME, PARAM_ADAPTER_IDLE_TIMEOUT, AdapterIdleTimeoutSec);
+		config_set_int(obs_config, SECTION_NAME, PARAM_ADAPTER_TX_BUFFER, AdapterTxBufferMB);
 		config_save(obs_config);
 	}
 }
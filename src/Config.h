@@ -34,6 +34,8 @@
 #define PARAM_MAIN_OUTPUT_VIDEO_SAMPLING "MainOutputComboBoxVideoSampling"
 #define PARAM_MAIN_OUTPUT_ALPHA_USED "MainOutputCheckBoxAlphaUsed"
 #define PARAM_MAIN_OUTPUT_BIT_DEPTH "MainOutputComboBoxBitDepth"
+#define PARAM_ADAPTER_IDLE_TIMEOUT "AdapterIdleTimeoutSec"
+#define PARAM_ADAPTER_TX_BUFFER "AdapterTxBufferMB"
 
 class Config {
   public:
@@ -55,6 +57,8 @@ class Config {
 	CdiAvmVideoSampling OutputVideoSampling;
 	bool OutputAlphaUsed;
 	CdiAvmVideoBitDepth OutputBitDepth;
+	int AdapterIdleTimeoutSec;
+	int AdapterTxBufferMB;
 
   private:
 	static Config* _instance;
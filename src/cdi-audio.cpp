@@ -0,0 +1,528 @@
+/*
+-------------------------------------------------------------------------------------------
+  Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+
+  Licensed under the Apache License, Version 2.0 (the "License").
+  You may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+-------------------------------------------------------------------------------------------
+*/
+
+
+/**
+ * @file
+ * @brief
+ * This file contains the audio processing of the CDI source.
+ *
+ * Payloads are converted from interleaved 24-bit big endian to float planes. Groupings OBS cannot play, such as 22.2,
+ * are downmixed with a gain matrix built from the usual -3 dB folds: each channel a smaller layout lacks is split
+ * equally between its nearest channels. Larger layouts are folded step by step, 22.2 to 7.1 to 5.1 to stereo.
+ *
+ * Received audio is put on a continuous timeline: each block is timestamped where the previous one ended. The sender
+ * produces samples at its own clock's rate, so over time the timeline drifts away from the block timestamps, which
+ * follow the OBS clock. A PI controller turns the smoothed difference into a resampling ratio a few ppm away from 1,
+ * which makes the timeline consume the sender's samples at the OBS clock's rate. Only large jumps, such as lost
+ * payloads or a restarted sender, reset the timeline.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "cdi-audio.h"
+#include "obs-cdi.h"
+
+//*********************************************************************************************************************
+//***************************************** START OF DEFINITIONS AND TYPES ********************************************
+//*********************************************************************************************************************
+
+// Largest correction applied, in ppm. Far above the drift of real clocks, but small enough to be inaudible.
+#define MAX_CORRECTION_PPM      (1000.0)
+
+// When the timeline is further than this from a block's timestamp, it is reset to the timestamp instead of corrected.
+// Well within the 70 ms at which OBS resets the audio of a source itself.
+#define TIMELINE_RESET_NS       (40000000.0)
+
+// Weight of each block in the smoothed timeline error. Filters out the jitter left in the block timestamps.
+#define ERROR_SMOOTHING         (1.0 / 32.0)
+
+// Controller gains, for a critically damped loop with a time constant of about a minute. The proportional gain turns
+// 1 ms of error into 150 ppm of correction.
+#define CONTROLLER_KP           (0.15)
+#define CONTROLLER_KI           (0.011)
+
+// -3 dB.
+#define GAIN_3DB                (0.70710678f)
+
+// Number of samples per channel converted and mixed at a time. The converted inputs of a chunk of 22.2 take 24 KB.
+#define MIX_CHUNK_FRAMES        (256)
+
+// OBS channel orders (see audio-io.h) used to index the matrices below.
+enum { OBS_FL, OBS_FR, OBS_FC, OBS_LFE, OBS_RL, OBS_RR, OBS_SL, OBS_SR };
+
+// 22.2 channel order (SMPTE ST 2036-2, Table 1).
+enum {
+    CDI222_FL, CDI222_FR, CDI222_FC, CDI222_LFE1, CDI222_BL, CDI222_BR, CDI222_FLC, CDI222_FRC, CDI222_BC,
+    CDI222_LFE2, CDI222_SIL, CDI222_SIR, CDI222_TPFL, CDI222_TPFR, CDI222_TPFC, CDI222_TPC, CDI222_TPBL, CDI222_TPBR,
+    CDI222_TPSIL, CDI222_TPSIR, CDI222_TPBC, CDI222_BTFC, CDI222_BTFL, CDI222_BTFR
+};
+
+/**
+ * @brief A gain matrix of up to 8 outputs by up to 24 inputs.
+ */
+struct MixMatrix {
+    int rows;                                               ///< Number of outputs.
+    int cols;                                               ///< Number of inputs.
+    float gain[MAX_AV_PLANES][CDI_MAX_AUDIO_CHANNELS];      ///< Gain of each input in each output.
+};
+
+//*********************************************************************************************************************
+//******************************************* START OF STATIC FUNCTIONS ***********************************************
+//*********************************************************************************************************************
+
+/**
+ * @brief Make a matrix that passes its inputs through unchanged. At most MAX_AV_PLANES channels.
+ */
+static void IdentityMatrix(int channels, MixMatrix* matrix_ptr)
+{
+    *matrix_ptr = {};
+    matrix_ptr->rows = channels;
+    matrix_ptr->cols = channels;
+    for (int i = 0; i < channels; i++) {
+        matrix_ptr->gain[i][i] = 1.0f;
+    }
+}
+
+/**
+ * @brief Apply a fold to a matrix, making it output the fold's outputs.
+ *
+ * @param fold_ptr Pointer to the fold, whose inputs are the outputs of the matrix.
+ * @param matrix_ptr Pointer to the matrix to update.
+ */
+static void ApplyFold(const MixMatrix* fold_ptr, MixMatrix* matrix_ptr)
+{
+    MixMatrix result = {};
+    result.rows = fold_ptr->rows;
+    result.cols = matrix_ptr->cols;
+    for (int o = 0; o < result.rows; o++) {
+        for (int k = 0; k < fold_ptr->cols; k++) {
+            for (int i = 0; i < result.cols; i++) {
+                result.gain[o][i] += fold_ptr->gain[o][k] * matrix_ptr->gain[k][i];
+            }
+        }
+    }
+    *matrix_ptr = result;
+}
+
+/**
+ * @brief Fold 22.2 into 7.1, in OBS order. Height and extra channels go to their nearest 7.1 channels at -3 dB, and
+ * the two LFE channels are combined.
+ */
+static void Fold222To71(MixMatrix* fold_ptr)
+{
+    *fold_ptr = {};
+    fold_ptr->rows = 8;
+    fold_ptr->cols = 24;
+    float (*g)[CDI_MAX_AUDIO_CHANNELS] = fold_ptr->gain;
+
+    g[OBS_FL][CDI222_FL] = 1.0f;
+    g[OBS_FL][CDI222_FLC] = GAIN_3DB;
+    g[OBS_FL][CDI222_TPFL] = GAIN_3DB;
+    g[OBS_FL][CDI222_BTFL] = GAIN_3DB;
+    g[OBS_FR][CDI222_FR] = 1.0f;
+    g[OBS_FR][CDI222_FRC] = GAIN_3DB;
+    g[OBS_FR][CDI222_TPFR] = GAIN_3DB;
+    g[OBS_FR][CDI222_BTFR] = GAIN_3DB;
+    g[OBS_FC][CDI222_FC] = 1.0f;
+    g[OBS_FC][CDI222_FLC] = GAIN_3DB;
+    g[OBS_FC][CDI222_FRC] = GAIN_3DB;
+    g[OBS_FC][CDI222_TPFC] = GAIN_3DB;
+    g[OBS_FC][CDI222_BTFC] = GAIN_3DB;
+    g[OBS_LFE][CDI222_LFE1] = GAIN_3DB;
+    g[OBS_LFE][CDI222_LFE2] = GAIN_3DB;
+    g[OBS_RL][CDI222_BL] = 1.0f;
+    g[OBS_RL][CDI222_BC] = GAIN_3DB;
+    g[OBS_RL][CDI222_TPBL] = GAIN_3DB;
+    g[OBS_RL][CDI222_TPBC] = 0.5f;
+    g[OBS_RR][CDI222_BR] = 1.0f;
+    g[OBS_RR][CDI222_BC] = GAIN_3DB;
+    g[OBS_RR][CDI222_TPBR] = GAIN_3DB;
+    g[OBS_RR][CDI222_TPBC] = 0.5f;
+    g[OBS_SL][CDI222_SIL] = 1.0f;
+    g[OBS_SL][CDI222_TPSIL] = GAIN_3DB;
+    g[OBS_SL][CDI222_TPC] = 0.5f;
+    g[OBS_SR][CDI222_SIR] = 1.0f;
+    g[OBS_SR][CDI222_TPSIR] = GAIN_3DB;
+    g[OBS_SR][CDI222_TPC] = 0.5f;
+}
+
+/**
+ * @brief Reorder CDI 7.1 (L, R, C, LFE, Lss, Rss, Lrs, Rrs) to OBS 7.1 (FL, FR, FC, LFE, RL, RR, SL, SR).
+ */
+static void Fold71ToObsOrder(MixMatrix* fold_ptr)
+{
+    IdentityMatrix(8, fold_ptr);
+    fold_ptr->gain[OBS_RL][OBS_RL] = 0.0f;
+    fold_ptr->gain[OBS_RR][OBS_RR] = 0.0f;
+    fold_ptr->gain[OBS_SL][OBS_SL] = 0.0f;
+    fold_ptr->gain[OBS_SR][OBS_SR] = 0.0f;
+    fold_ptr->gain[OBS_RL][6] = 1.0f; // Lrs
+    fold_ptr->gain[OBS_RR][7] = 1.0f; // Rrs
+    fold_ptr->gain[OBS_SL][4] = 1.0f; // Lss
+    fold_ptr->gain[OBS_SR][5] = 1.0f; // Rss
+}
+
+/**
+ * @brief Fold OBS 7.1 into 5.1: the side and rear channels become the 5.1 surrounds.
+ */
+static void Fold71To51(MixMatrix* fold_ptr)
+{
+    *fold_ptr = {};
+    fold_ptr->rows = 6;
+    fold_ptr->cols = 8;
+    for (int i = OBS_FL; i <= OBS_LFE; i++) {
+        fold_ptr->gain[i][i] = 1.0f;
+    }
+    fold_ptr->gain[OBS_RL][OBS_RL] = GAIN_3DB;
+    fold_ptr->gain[OBS_RL][OBS_SL] = GAIN_3DB;
+    fold_ptr->gain[OBS_RR][OBS_RR] = GAIN_3DB;
+    fold_ptr->gain[OBS_RR][OBS_SR] = GAIN_3DB;
+}
+
+/**
+ * @brief Fold OBS 5.1 into stereo (ITU-R BS.775). The LFE channel is dropped.
+ */
+static void Fold51ToStereo(MixMatrix* fold_ptr)
+{
+    *fold_ptr = {};
+    fold_ptr->rows = 2;
+    fold_ptr->cols = 6;
+    fold_ptr->gain[OBS_FL][OBS_FL] = 1.0f;
+    fold_ptr->gain[OBS_FL][OBS_FC] = GAIN_3DB;
+    fold_ptr->gain[OBS_FL][OBS_RL] = GAIN_3DB;
+    fold_ptr->gain[OBS_FR][OBS_FR] = 1.0f;
+    fold_ptr->gain[OBS_FR][OBS_FC] = GAIN_3DB;
+    fold_ptr->gain[OBS_FR][OBS_RR] = GAIN_3DB;
+}
+
+/**
+ * @brief Fold OBS 4.0 (FL, FR, FC, RC) into stereo.
+ */
+static void Fold40ToStereo(MixMatrix* fold_ptr)
+{
+    *fold_ptr = {};
+    fold_ptr->rows = 2;
+    fold_ptr->cols = 4;
+    fold_ptr->gain[0][0] = 1.0f;
+    fold_ptr->gain[0][2] = GAIN_3DB;
+    fold_ptr->gain[0][3] = GAIN_3DB;
+    fold_ptr->gain[1][1] = 1.0f;
+    fold_ptr->gain[1][2] = GAIN_3DB;
+    fold_ptr->gain[1][3] = GAIN_3DB;
+}
+
+/**
+ * @brief Convert a 24-bit big endian sample to float.
+ */
+static inline float S24ToFloat(const uint8_t* sample_ptr)
+{
+    int32_t value = (int32_t)(((uint32_t)sample_ptr[0] << 24) | ((uint32_t)sample_ptr[1] << 16) |
+                              ((uint32_t)sample_ptr[2] << 8));
+    return (float)value * (1.0f / 2147483648.0f);
+}
+
+/**
+ * @brief Convert one channel of interleaved 24-bit big endian samples to float.
+ *
+ * @param src_ptr Pointer to the channel's first sample.
+ * @param stride Number of bytes from one sample of the channel to the next.
+ * @param dst_ptr Pointer to the float samples.
+ * @param frames Number of samples.
+ */
+static void ConvertChannel(const uint8_t* src_ptr, int stride, float* dst_ptr, int frames)
+{
+    for (int t = 0; t < frames; t++) {
+        dst_ptr[t] = S24ToFloat(src_ptr);
+        src_ptr += stride;
+    }
+}
+
+//*********************************************************************************************************************
+//******************************************* START OF PUBLIC FUNCTIONS ***********************************************
+//*********************************************************************************************************************
+
+int CdiAudioGroupingChannels(CdiAvmAudioChannelGrouping grouping)
+{
+    switch (grouping) {
+        case kCdiAvmAudioM: // Mono.
+            return 1;
+        case kCdiAvmAudioDM: // Dual mono (M1, M2).
+        case kCdiAvmAudioST: // Standard Stereo (left, right).
+        case kCdiAvmAudioLtRt: // Matrix Stereo (Lt, Rt).
+            return 2;
+        case kCdiAvmAudioSGRP: // One SDI audio group (1, 2, 3, 4).
+            return 4;
+        case kCdiAvmAudio51: // 5.1 Surround (L, R, C, LFE, Ls, Rs).
+            return 6;
+        case kCdiAvmAudio71: // Surround (L, R, C, LFE, Lss, Rss, Lrs, Rrs).
+            return 8;
+        case kCdiAvmAudio222: // 22.2 Surround (SMPTE ST 2036-2, Table 1).
+            return 24;
+        default:
+            return 0;
+    }
+}
+
+bool CdiAudioResolveMix(CdiAvmAudioChannelGrouping grouping, int max_channels, CdiAudioMix* mix_ptr)
+{
+    int in_channels = CdiAudioGroupingChannels(grouping);
+    if (0 == in_channels) {
+        return false;
+    }
+
+    // Start from the grouping's own layout in OBS order, then fold it down until it fits.
+    MixMatrix matrix;
+    MixMatrix fold;
+    speaker_layout speakers = SPEAKERS_UNKNOWN;
+    switch (in_channels) {
+        case 1:
+            IdentityMatrix(in_channels, &matrix);
+            speakers = SPEAKERS_MONO;
+            break;
+        case 2:
+            IdentityMatrix(in_channels, &matrix);
+            speakers = SPEAKERS_STEREO;
+            break;
+        case 4:
+            IdentityMatrix(in_channels, &matrix);
+            speakers = SPEAKERS_4POINT0;
+            break;
+        case 6:
+            IdentityMatrix(in_channels, &matrix);
+            speakers = SPEAKERS_5POINT1;
+            break;
+        case 8:
+            Fold71ToObsOrder(&matrix);
+            speakers = SPEAKERS_7POINT1;
+            break;
+        default:
+            // 22.2. OBS supports at most 8 channels.
+            Fold222To71(&matrix);
+            speakers = SPEAKERS_7POINT1;
+            break;
+    }
+    if (matrix.rows > max_channels && SPEAKERS_7POINT1 == speakers) {
+        Fold71To51(&fold);
+        ApplyFold(&fold, &matrix);
+        speakers = SPEAKERS_5POINT1;
+    }
+    if (matrix.rows > max_channels && SPEAKERS_5POINT1 == speakers) {
+        Fold51ToStereo(&fold);
+        ApplyFold(&fold, &matrix);
+        speakers = SPEAKERS_STEREO;
+    }
+    if (matrix.rows > max_channels && SPEAKERS_4POINT0 == speakers) {
+        Fold40ToStereo(&fold);
+        ApplyFold(&fold, &matrix);
+        speakers = SPEAKERS_STEREO;
+    }
+
+    *mix_ptr = {};
+    mix_ptr->in_channels = in_channels;
+    mix_ptr->out_channels = matrix.rows;
+    mix_ptr->speakers = speakers;
+    memcpy(mix_ptr->matrix, matrix.gain, sizeof(mix_ptr->matrix));
+
+    // Mixes that only pick and reorder channels are done without the matrix.
+    mix_ptr->mapped = true;
+    for (int o = 0; o < matrix.rows && mix_ptr->mapped; o++) {
+        int sources = 0;
+        for (int i = 0; i < in_channels; i++) {
+            if (0.0f != matrix.gain[o][i]) {
+                sources++;
+                mix_ptr->channel_map[o] = i;
+                mix_ptr->mapped = mix_ptr->mapped && (1.0f == matrix.gain[o][i]);
+            }
+        }
+        mix_ptr->mapped = mix_ptr->mapped && (1 == sources);
+    }
+    return true;
+}
+
+void CdiAudioConvert(const uint8_t* payload_ptr, int frames, const CdiAudioMix* mix_ptr, float* const out[])
+{
+    const int stride = mix_ptr->in_channels * CDI_BYTES_PER_AUDIO_SAMPLE;
+
+    if (mix_ptr->mapped) {
+        for (int o = 0; o < mix_ptr->out_channels; o++) {
+            ConvertChannel(payload_ptr + mix_ptr->channel_map[o] * CDI_BYTES_PER_AUDIO_SAMPLE, stride, out[o],
+                           frames);
+        }
+        return;
+    }
+
+    // Inputs that no output uses are not converted.
+    bool used[CDI_MAX_AUDIO_CHANNELS] = {};
+    for (int o = 0; o < mix_ptr->out_channels; o++) {
+        for (int i = 0; i < mix_ptr->in_channels; i++) {
+            used[i] = used[i] || (0.0f != mix_ptr->matrix[o][i]);
+        }
+    }
+
+    // Runs on the Rx worker thread of each receiver, so keep one chunk per thread.
+    thread_local float chunk[CDI_MAX_AUDIO_CHANNELS][MIX_CHUNK_FRAMES];
+
+    for (int start = 0; start < frames; start += MIX_CHUNK_FRAMES) {
+        int count = (std::min)(MIX_CHUNK_FRAMES, frames - start);
+        const uint8_t* chunk_ptr = payload_ptr + (size_t)start * stride;
+        for (int i = 0; i < mix_ptr->in_channels; i++) {
+            if (used[i]) {
+                ConvertChannel(chunk_ptr + i * CDI_BYTES_PER_AUDIO_SAMPLE, stride, chunk[i], count);
+            }
+        }
+
+        // Each output is the sum of its few inputs, with contiguous loops that vectorize.
+        for (int o = 0; o < mix_ptr->out_channels; o++) {
+            float* dst_ptr = out[o] + start;
+            bool first = true;
+            for (int i = 0; i < mix_ptr->in_channels; i++) {
+                const float gain = mix_ptr->matrix[o][i];
+                if (0.0f == gain) {
+                    continue;
+                }
+                const float* src_ptr = chunk[i];
+                if (first) {
+                    for (int t = 0; t < count; t++) {
+                        dst_ptr[t] = gain * src_ptr[t];
+                    }
+                    first = false;
+                } else {
+                    for (int t = 0; t < count; t++) {
+                        dst_ptr[t] += gain * src_ptr[t];
+                    }
+                }
+            }
+            if (first) {
+                memset(dst_ptr, 0, count * sizeof(float));
+            }
+        }
+    }
+}
+
+void CdiAudioResampler::Reset(int channels)
+{
+    num_channels = channels;
+    // The first output sample is the first input sample.
+    position = 0.0;
+    history.assign(channels, 0.0f);
+}
+
+int CdiAudioResampler::Process(const float* const in[], int in_frames, double ratio, float* const out[],
+                               int max_out_frames)
+{
+    if (in_frames <= 0) {
+        return 0;
+    }
+
+    // Output samples are interpolated between input samples floor(position) and floor(position) + 1, so the last
+    // usable position is just before the block's last sample. The ratio is so close to 1 that the integer part of the
+    // position advances by exactly 1 per output sample for long runs, within which the two interpolated samples are
+    // contiguous in the input. Find the runs first, so they can be applied to each channel with loops that vectorize.
+    const double end = (double)(in_frames - 1);
+    const double step = ratio - 1.0;
+    int out_frames = 0;
+    double pos = position;
+
+    runs.clear();
+    while (pos < end && out_frames < max_out_frames) {
+        int base = (int)floor(pos);
+        double frac = pos - base;
+        int count = (int)ceil((end - pos) / ratio);
+        if (step > 0.0) {
+            count = (std::min)(count, (int)ceil((1.0 - frac) / step));
+        } else if (step < 0.0) {
+            count = (std::min)(count, (int)floor(frac / -step) + 1);
+        }
+        count = (std::max)(1, (std::min)(count, max_out_frames - out_frames));
+
+        runs.push_back({ base, (float)frac, count });
+        out_frames += count;
+        pos += count * ratio;
+    }
+
+    if (line.size() < (size_t)in_frames + 1) {
+        line.resize(in_frames + 1);
+    }
+    const float frac_step = (float)step;
+    for (int ch = 0; ch < num_channels; ch++) {
+        // line[0] is input sample -1, the last sample of the previous block.
+        line[0] = history[ch];
+        memcpy(&line[1], in[ch], in_frames * sizeof(float));
+
+        float* dst_ptr = out[ch];
+        for (const Run& run : runs) {
+            const float* a_ptr = &line[run.base + 1];
+            const float* b_ptr = &line[run.base + 2];
+            for (int i = 0; i < run.count; i++) {
+                float t = run.frac + frac_step * (float)i;
+                dst_ptr[i] = a_ptr[i] + t * (b_ptr[i] - a_ptr[i]);
+            }
+            dst_ptr += run.count;
+        }
+        history[ch] = in[ch][in_frames - 1];
+    }
+
+    position = pos - in_frames;
+    return out_frames;
+}
+
+void CdiAudioDriftCompensator::Reset(int channels, uint32_t sample_rate)
+{
+    resampler.Reset(channels);
+    num_channels = channels;
+    samples_per_sec = sample_rate;
+    running = false;
+    error_s = 0.0;
+    integral = 0.0;
+    ratio = 1.0;
+}
+
+int CdiAudioDriftCompensator::Process(const float* const in[], int in_frames, uint64_t timestamp,
+                                      float* const out[], uint64_t* out_timestamp_ptr)
+{
+    double raw_error_ns = next_time_ns - (double)timestamp;
+    if (!running || fabs(raw_error_ns) > TIMELINE_RESET_NS) {
+        if (running) {
+            resets++;
+        }
+        // The integral holds the drift of the clocks, which a jump does not change, so it is kept.
+        resampler.Reset(num_channels);
+        next_time_ns = (double)timestamp;
+        raw_error_ns = 0.0;
+        error_s = 0.0;
+        running = true;
+    }
+
+    // A positive error means the timeline is ahead of the timestamps, so more samples came in than OBS time passed:
+    // the sender's clock is fast and the input must be consumed faster.
+    error_s += (raw_error_ns / 1000000000.0 - error_s) * ERROR_SMOOTHING;
+    double block_s = (double)in_frames / samples_per_sec;
+    const double max_correction = MAX_CORRECTION_PPM / 1000000.0;
+    integral = (std::max)(-max_correction, (std::min)(max_correction, integral + CONTROLLER_KI * error_s * block_s));
+    double correction = CONTROLLER_KP * error_s + integral;
+    ratio = 1.0 + (std::max)(-max_correction, (std::min)(max_correction, correction));
+
+    int out_frames = resampler.Process(in, in_frames, ratio, out, in_frames + 2);
+
+    *out_timestamp_ptr = (uint64_t)next_time_ns;
+    next_time_ns += out_frames * 1000000000.0 / samples_per_sec;
+    return out_frames;
+}
@@ -0,0 +1,180 @@
+/*
+-------------------------------------------------------------------------------------------
+  Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+
+  Licensed under the Apache License, Version 2.0 (the "License").
+  You may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+-------------------------------------------------------------------------------------------
+*/
+
+/**
+ * @file
+ * @brief
+ * This file contains the declarations of the audio processing of the CDI source: converting received payloads to
+ * float planes, downmixing channel groupings OBS cannot play, and compensating clock drift. The sender's audio clock
+ * and the OBS clock never run at exactly the same rate, so received audio is resampled by a few ppm to keep its
+ * latency constant.
+*/
+
+#ifndef CDI_AUDIO_H
+#define CDI_AUDIO_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <obs-module.h>
+
+extern "C" {
+#include "cdi_baseline_profile_02_00_api.h"
+};
+
+/// @brief Largest number of channels of a CDI audio grouping (22.2).
+#define CDI_MAX_AUDIO_CHANNELS  (24)
+
+/**
+ * @brief How the channels of a CDI audio payload become OBS channels.
+ */
+struct CdiAudioMix {
+    int in_channels;                ///< Number of channels in the CDI payload.
+    int out_channels;               ///< Number of channels output to OBS.
+    speaker_layout speakers;        ///< OBS speaker layout of the output.
+    bool mapped;                    ///< true if each output is one input as is, see channel_map.
+    int channel_map[MAX_AV_PLANES]; ///< Input channel of each output channel, if mapped.
+    float matrix[MAX_AV_PLANES][CDI_MAX_AUDIO_CHANNELS]; ///< Gain of each input in each output, if not mapped.
+};
+
+/**
+ * @brief Get the number of channels of a CDI audio grouping.
+ *
+ * @param grouping CDI audio channel grouping.
+ *
+ * @return Number of channels, or 0 if the grouping is unknown.
+ */
+int CdiAudioGroupingChannels(CdiAvmAudioChannelGrouping grouping);
+
+/**
+ * @brief Resolve how a CDI audio grouping is output to OBS. Groupings with more than max_channels channels, and 22.2
+ * always, are downmixed to 7.1, 5.1 or stereo. The channels of the others are only reordered to OBS's order.
+ *
+ * @param grouping CDI audio channel grouping.
+ * @param max_channels Most channels to output: 8, 6 or 2.
+ * @param mix_ptr Pointer to the mix to fill in.
+ *
+ * @return true if successful, false if the grouping is unknown.
+ */
+bool CdiAudioResolveMix(CdiAvmAudioChannelGrouping grouping, int max_channels, CdiAudioMix* mix_ptr);
+
+/**
+ * @brief Convert the interleaved 24-bit big endian samples of a CDI audio payload to float planes, applying the mix.
+ * Downmixing is done in chunks that stay in the L1 cache right after each chunk is converted, and only the inputs a
+ * mix uses are converted.
+ *
+ * @param payload_ptr Pointer to the CDI audio payload.
+ * @param frames Number of samples per channel in the payload.
+ * @param mix_ptr Pointer to the mix.
+ * @param out One output plane of frames samples per output channel.
+ */
+void CdiAudioConvert(const uint8_t* payload_ptr, int frames, const CdiAudioMix* mix_ptr, float* const out[]);
+
+/**
+ * @brief Resamples planar float audio by a ratio close to 1, using linear interpolation. The ratio can change with each
+ * block without discontinuities.
+ */
+class CdiAudioResampler {
+public:
+    /**
+     * @brief Start over, forgetting the samples of previous blocks.
+     *
+     * @param channels Number of audio channels.
+     */
+    void Reset(int channels);
+
+    /**
+     * @brief Resample a block of audio.
+     *
+     * @param in Input planes, one per channel.
+     * @param in_frames Number of input samples per channel.
+     * @param ratio Input samples consumed per output sample. Must be within 1% of 1.
+     * @param out Output planes, one per channel.
+     * @param max_out_frames Number of samples per channel the output planes can hold. in_frames + 2 is always enough.
+     *
+     * @return Number of output samples per channel.
+     */
+    int Process(const float* const in[], int in_frames, double ratio, float* const out[], int max_out_frames);
+
+private:
+    int num_channels = 0;           ///< Number of audio channels.
+    double position = 0.0;          ///< Input position of the next output sample. -1 is the last sample of the
+                                    ///< previous block.
+    std::vector<float> history;     ///< Last input sample of each channel.
+    std::vector<float> line;        ///< A channel's last sample followed by its block, so reads are contiguous.
+
+    /// @brief Output samples that interpolate between contiguous input samples.
+    struct Run {
+        int base;                   ///< Input sample before the first output sample.
+        float frac;                 ///< Position of the first output sample after base.
+        int count;                  ///< Number of output samples.
+    };
+    std::vector<Run> runs;          ///< Runs of the block being resampled.
+};
+
+/**
+ * @brief Keeps the audio of a source on a continuous timeline that follows the OBS clock. Each block is timestamped
+ * where the previous one ended, and the difference to the block's own timestamp drives a PI controller that sets the
+ * resampling ratio, so the difference stays at zero however long the source runs.
+ */
+class CdiAudioDriftCompensator {
+public:
+    /**
+     * @brief Start over, for example when the audio format changes.
+     *
+     * @param channels Number of audio channels.
+     * @param sample_rate Sample rate in Hz.
+     */
+    void Reset(int channels, uint32_t sample_rate);
+
+    /**
+     * @brief Compensate a block of audio.
+     *
+     * @param in Input planes, one per channel.
+     * @param in_frames Number of input samples per channel.
+     * @param timestamp Time of the first sample of the block on the OBS clock.
+     * @param out Output planes, one per channel, of at least in_frames + 2 samples.
+     * @param out_timestamp_ptr Set to the time of the first output sample on the OBS clock.
+     *
+     * @return Number of output samples per channel.
+     */
+    int Process(const float* const in[], int in_frames, uint64_t timestamp, float* const out[],
+                uint64_t* out_timestamp_ptr);
+
+    /// @brief Current correction in ppm. Positive when the sender's clock runs fast.
+    double CorrectionPpm() const { return (ratio - 1.0) * 1000000.0; }
+
+    /// @brief Smoothed difference in nanoseconds between the timeline and the block timestamps.
+    int64_t ErrorNs() const { return (int64_t)(error_s * 1000000000.0); }
+
+    /// @brief Number of times the timeline was reset because it was too far from the block timestamps.
+    uint64_t Resets() const { return resets; }
+
+private:
+    CdiAudioResampler resampler;    ///< Resampler applying the correction.
+    int num_channels = 0;           ///< Number of audio channels.
+    uint32_t samples_per_sec = 0;   ///< Sample rate in Hz.
+    bool running = false;           ///< true once the timeline has started.
+    double next_time_ns = 0.0;      ///< Time on the OBS clock of the next output sample.
+    double error_s = 0.0;           ///< Smoothed timeline error in seconds.
+    double integral = 0.0;          ///< Integral term of the controller.
+    double ratio = 1.0;             ///< Current resampling ratio.
+    uint64_t resets = 0;            ///< Number of timeline resets.
+};
+
+#endif // CDI_AUDIO_H
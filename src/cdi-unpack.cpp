@@ -0,0 +1,971 @@
+/*
+-------------------------------------------------------------------------------------------
+  Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+
+  Licensed under the Apache License, Version 2.0 (the "License").
+  You may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+-------------------------------------------------------------------------------------------
+*/
+
+/**
+ * @file
+ * @brief
+ * This file contains the kernels that unpack received CDI video payloads into OBS planes.
+ *
+ * Each line is unpacked in two steps. First the 10-bit or 12-bit samples of the line are narrowed to 8-bit (8-bit
+ * payloads skip this step), then the interleaved 8-bit samples are split into planes (YCbCr 4:4:4) or reordered to
+ * BGRA (RGB). YCbCr 4:2:2 only needs the first step, as CDI's sample order is the same as UYVY. Both steps have a
+ * scalar reference and SSSE3 variants, narrowing also has an AVX2 variant. The variants are picked once at runtime
+ * from what the CPU supports.
+ *
+ * 10-bit and 12-bit YCbCr can instead keep their precision: the samples are widened to 16-bit with the sample in the
+ * most significant bits, then split into the luma and interleaved chroma planes of P216 (4:2:2) or P416 (4:4:4).
+ *
+ * Proxies are unpacked at 1/2 or 1/4 of the size by picking the samples of every 2nd or 4th pixel of every 2nd or
+ * 4th line straight from the packed payload. Lines that are skipped are never read, and no sample is narrowed that is
+ * not output.
+*/
+
+#include <obs-module.h>
+#include <algorithm>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+#include "cdi-unpack.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CDI_UNPACK_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC always allows the intrinsics, so no target attributes are needed.
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+//*********************************************************************************************************************
+//***************************************** START OF DEFINITIONS AND TYPES ********************************************
+//*********************************************************************************************************************
+
+/// @brief Narrow the first count samples of a packed line to 8-bit. in_size is the number of bytes that may be read.
+typedef void (*NarrowLineFn)(const uint8_t* in_ptr, int in_size, uint8_t* out_ptr, int count);
+
+/// @brief Split a line of 8-bit interleaved YCbCr samples into Y, U and V planes.
+typedef void (*SplitLineFn)(const uint8_t* in_ptr, uint8_t* y_ptr, uint8_t* u_ptr, uint8_t* v_ptr, int width);
+
+/// @brief Convert a line of 8-bit RGB samples to BGRA with opaque alpha.
+typedef void (*RgbLineFn)(const uint8_t* in_ptr, uint8_t* out_ptr, int width);
+
+/// @brief Write a line of 8-bit alpha samples into the alpha bytes of a BGRA line.
+typedef void (*AlphaLineFn)(const uint8_t* in_ptr, uint8_t* out_ptr, int width);
+
+/// @brief Widen the first count samples of a packed line to MSB aligned 16-bit. in_size is the number of bytes that
+/// may be read.
+typedef void (*WidenLineFn)(const uint8_t* in_ptr, int in_size, uint16_t* out_ptr, int count);
+
+/// @brief Split a line of 16-bit interleaved YCbCr samples into a Y plane and an interleaved CbCr plane.
+typedef void (*SplitLine16Fn)(const uint16_t* in_ptr, uint16_t* y_ptr, uint16_t* uv_ptr, int width);
+
+/**
+ * @brief The set of line kernels used to unpack payloads.
+ */
+struct UnpackKernels {
+    const char* name_str;       ///< Name of the kernel set, for logging.
+    NarrowLineFn narrow_10bit;  ///< 10-bit to 8-bit narrowing.
+    NarrowLineFn narrow_12bit;  ///< 12-bit to 8-bit narrowing.
+    SplitLineFn split_444;      ///< CB,Y,CR to I444.
+    RgbLineFn rgb_to_bgra;      ///< R,G,B to B,G,R,0xFF.
+    AlphaLineFn insert_alpha;   ///< Alpha plane into BGRA.
+    WidenLineFn widen_10bit;    ///< 10-bit to 16-bit widening.
+    WidenLineFn widen_12bit;    ///< 12-bit to 16-bit widening.
+    SplitLine16Fn split_p216;   ///< CB,Y0,CR,Y1 to P216.
+    SplitLine16Fn split_p416;   ///< CB,Y,CR to P416.
+};
+
+//*********************************************************************************************************************
+//******************************************* START OF STATIC FUNCTIONS ***********************************************
+//*********************************************************************************************************************
+
+/**
+ * @brief Scalar reference for narrowing packed samples to 8-bit. CDI packs samples big endian and back to back, so
+ * a sample always straddles two bytes for 10-bit and 12-bit depths.
+ *
+ * @param in_ptr Pointer to the packed line.
+ * @param bits Bits per sample, 10 or 12.
+ * @param out_ptr Pointer to the 8-bit samples.
+ * @param first Index of the first sample to narrow.
+ * @param count Index one past the last sample to narrow.
+ */
+static void NarrowSamples(const uint8_t* in_ptr, int bits, uint8_t* out_ptr, int first, int count)
+{
+    const uint16_t mask = (uint16_t)((1 << bits) - 1);
+    for (int i = first; i < count; i++) {
+        int bit_offset = i * bits;
+        const uint8_t* byte_ptr = in_ptr + (bit_offset >> 3);
+        uint16_t word = (uint16_t)((byte_ptr[0] << 8) | byte_ptr[1]);
+        uint16_t sample = (uint16_t)(word >> (16 - bits - (bit_offset & 7))) & mask;
+        out_ptr[i] = (uint8_t)(sample >> (bits - 8));
+    }
+}
+
+static void NarrowLine10Scalar(const uint8_t* in_ptr, int in_size, uint8_t* out_ptr, int count)
+{
+    (void)in_size;
+    NarrowSamples(in_ptr, 10, out_ptr, 0, count);
+}
+
+static void NarrowLine12Scalar(const uint8_t* in_ptr, int in_size, uint8_t* out_ptr, int count)
+{
+    (void)in_size;
+    NarrowSamples(in_ptr, 12, out_ptr, 0, count);
+}
+
+static void SplitLine444Scalar(const uint8_t* in_ptr, uint8_t* y_ptr, uint8_t* u_ptr, uint8_t* v_ptr, int width)
+{
+    // 4:4:4: CB,Y,CR (CB = U, CR= V, Y=Y)
+    for (int x = 0; x < width; x++) {
+        u_ptr[x] = in_ptr[0];
+        y_ptr[x] = in_ptr[1];
+        v_ptr[x] = in_ptr[2];
+        in_ptr += 3;
+    }
+}
+
+static void RgbLineScalar(const uint8_t* in_ptr, uint8_t* out_ptr, int width)
+{
+    for (int x = 0; x < width; x++) {
+        out_ptr[0] = in_ptr[2]; // B
+        out_ptr[1] = in_ptr[1]; // G
+        out_ptr[2] = in_ptr[0]; // R
+        out_ptr[3] = 0xFF;      // A
+        in_ptr += 3;
+        out_ptr += 4;
+    }
+}
+
+static void AlphaLineScalar(const uint8_t* in_ptr, uint8_t* out_ptr, int width)
+{
+    for (int x = 0; x < width; x++) {
+        out_ptr[x * 4 + 3] = in_ptr[x];
+    }
+}
+
+/**
+ * @brief Scalar reference for widening packed samples to 16-bit, with the sample in the most significant bits as
+ * P216 and P416 expect.
+ *
+ * @param in_ptr Pointer to the packed line.
+ * @param bits Bits per sample, 10 or 12.
+ * @param out_ptr Pointer to the 16-bit samples.
+ * @param first Index of the first sample to widen.
+ * @param count Index one past the last sample to widen.
+ */
+static void WidenSamples(const uint8_t* in_ptr, int bits, uint16_t* out_ptr, int first, int count)
+{
+    const uint16_t mask = (uint16_t)((1 << bits) - 1);
+    for (int i = first; i < count; i++) {
+        int bit_offset = i * bits;
+        const uint8_t* byte_ptr = in_ptr + (bit_offset >> 3);
+        uint16_t word = (uint16_t)((byte_ptr[0] << 8) | byte_ptr[1]);
+        uint16_t sample = (uint16_t)(word >> (16 - bits - (bit_offset & 7))) & mask;
+        out_ptr[i] = (uint16_t)(sample << (16 - bits));
+    }
+}
+
+static void WidenLine10Scalar(const uint8_t* in_ptr, int in_size, uint16_t* out_ptr, int count)
+{
+    (void)in_size;
+    WidenSamples(in_ptr, 10, out_ptr, 0, count);
+}
+
+static void WidenLine12Scalar(const uint8_t* in_ptr, int in_size, uint16_t* out_ptr, int count)
+{
+    (void)in_size;
+    WidenSamples(in_ptr, 12, out_ptr, 0, count);
+}
+
+static void SplitLineP216Scalar(const uint16_t* in_ptr, uint16_t* y_ptr, uint16_t* uv_ptr, int width)
+{
+    // 4:2:2: CB,Y0,CR,Y1. The chroma plane keeps CB,CR interleaved.
+    for (int x = 0; x < width; x += 2) {
+        uv_ptr[x] = in_ptr[0];
+        y_ptr[x] = in_ptr[1];
+        uv_ptr[x + 1] = in_ptr[2];
+        y_ptr[x + 1] = in_ptr[3];
+        in_ptr += 4;
+    }
+}
+
+static void SplitLineP416Scalar(const uint16_t* in_ptr, uint16_t* y_ptr, uint16_t* uv_ptr, int width)
+{
+    // 4:4:4: CB,Y,CR. The chroma plane keeps CB,CR interleaved.
+    for (int x = 0; x < width; x++) {
+        uv_ptr[x * 2] = in_ptr[0];
+        y_ptr[x] = in_ptr[1];
+        uv_ptr[x * 2 + 1] = in_ptr[2];
+        in_ptr += 3;
+    }
+}
+
+#ifdef CDI_UNPACK_X86
+
+// The narrowing kernels gather the two bytes holding each sample into a 16-bit lane with a shuffle, then shift each
+// lane right by its own amount with an unsigned multiply-high (x * 2^(16-n) >> 16 == x >> n) and keep the low 8 bits.
+// 8 samples come from one 16-byte load: 10 bytes for 10-bit, 12 bytes for 12-bit.
+
+TARGET_SSSE3 static void NarrowLine10Ssse3(const uint8_t* in_ptr, int in_size, uint8_t* out_ptr, int count)
+{
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8);
+    const __m128i scale = _mm_setr_epi16(1 << 8, 1 << 10, 1 << 12, 1 << 14, 1 << 8, 1 << 10, 1 << 12, 1 << 14);
+    const __m128i low_byte = _mm_set1_epi16(0x00FF);
+
+    int i = 0;
+    int offset = 0;
+    // Each pass reads 16 bytes starting 10 bytes in, so stop before that would go past the line.
+    for (; i + 16 <= count && offset + 26 <= in_size; i += 16, offset += 20) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in_ptr + offset));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in_ptr + offset + 10));
+        a = _mm_and_si128(_mm_mulhi_epu16(_mm_shuffle_epi8(a, shuffle), scale), low_byte);
+        b = _mm_and_si128(_mm_mulhi_epu16(_mm_shuffle_epi8(b, shuffle), scale), low_byte);
+        _mm_storeu_si128((__m128i*)(out_ptr + i), _mm_packus_epi16(a, b));
+    }
+    NarrowSamples(in_ptr, 10, out_ptr, i, count);
+}
+
+TARGET_SSSE3 static void NarrowLine12Ssse3(const uint8_t* in_ptr, int in_size, uint8_t* out_ptr, int count)
+{
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i scale = _mm_setr_epi16(1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12);
+    const __m128i low_byte = _mm_set1_epi16(0x00FF);
+
+    int i = 0;
+    int offset = 0;
+    for (; i + 16 <= count && offset + 28 <= in_size; i += 16, offset += 24) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in_ptr + offset));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in_ptr + offset + 12));
+        a = _mm_and_si128(_mm_mulhi_epu16(_mm_shuffle_epi8(a, shuffle), scale), low_byte);
+        b = _mm_and_si128(_mm_mulhi_epu16(_mm_shuffle_epi8(b, shuffle), scale), low_byte);
+        _mm_storeu_si128((__m128i*)(out_ptr + i), _mm_packus_epi16(a, b));
+    }
+    NarrowSamples(in_ptr, 12, out_ptr, i, count);
+}
+
+TARGET_SSSE3 static void SplitLine444Ssse3(const uint8_t* in_ptr, uint8_t* y_ptr, uint8_t* u_ptr, uint8_t* v_ptr,
+                                           int width)
+{
+    const __m128i u_a = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i u_b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i u_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    const __m128i y_a = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i y_b = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+    const __m128i y_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+    const __m128i v_a = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i v_b = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i v_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8_t* src_ptr = in_ptr + x * 3;
+        __m128i a = _mm_loadu_si128((const __m128i*)(src_ptr));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src_ptr + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src_ptr + 32));
+        __m128i u = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, u_a), _mm_shuffle_epi8(b, u_b)),
+                                 _mm_shuffle_epi8(c, u_c));
+        __m128i y = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, y_a), _mm_shuffle_epi8(b, y_b)),
+                                 _mm_shuffle_epi8(c, y_c));
+        __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, v_a), _mm_shuffle_epi8(b, v_b)),
+                                 _mm_shuffle_epi8(c, v_c));
+        _mm_storeu_si128((__m128i*)(u_ptr + x), u);
+        _mm_storeu_si128((__m128i*)(y_ptr + x), y);
+        _mm_storeu_si128((__m128i*)(v_ptr + x), v);
+    }
+    SplitLine444Scalar(in_ptr + x * 3, y_ptr + x, u_ptr + x, v_ptr + x, width - x);
+}
+
+TARGET_SSSE3 static void RgbLineSsse3(const uint8_t* in_ptr, uint8_t* out_ptr, int width)
+{
+    // 4 pixels (12 bytes) per shuffle, alpha lanes zeroed and then set to 0xFF.
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+    int x = 0;
+    // The last load of a pass starts at byte 36 and reads 16 bytes, so 18 pixels (54 bytes) must be available.
+    for (; x + 18 <= width; x += 16) {
+        const uint8_t* src_ptr = in_ptr + x * 3;
+        uint8_t* dst_ptr = out_ptr + x * 4;
+        for (int q = 0; q < 4; q++) {
+            __m128i rgb = _mm_loadu_si128((const __m128i*)(src_ptr + q * 12));
+            _mm_storeu_si128((__m128i*)(dst_ptr + q * 16), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+        }
+    }
+    RgbLineScalar(in_ptr + x * 3, out_ptr + x * 4, width - x);
+}
+
+TARGET_SSSE3 static void AlphaLineSsse3(const uint8_t* in_ptr, uint8_t* out_ptr, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color = _mm_set1_epi32(0x00FFFFFF);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in_ptr + x));
+        // Move each alpha byte to the top byte of its own 32-bit lane.
+        __m128i lo = _mm_unpacklo_epi8(zero, a);
+        __m128i hi = _mm_unpackhi_epi8(zero, a);
+        __m128i lanes[4] = { _mm_unpacklo_epi16(zero, lo), _mm_unpackhi_epi16(zero, lo),
+                             _mm_unpacklo_epi16(zero, hi), _mm_unpackhi_epi16(zero, hi) };
+        uint8_t* dst_ptr = out_ptr + x * 4;
+        for (int q = 0; q < 4; q++) {
+            __m128i bgra = _mm_loadu_si128((const __m128i*)(dst_ptr + q * 16));
+            _mm_storeu_si128((__m128i*)(dst_ptr + q * 16), _mm_or_si128(_mm_and_si128(bgra, color), lanes[q]));
+        }
+    }
+    AlphaLineScalar(in_ptr + x, out_ptr + x * 4, width - x);
+}
+
+// The widening kernels gather samples like the narrowing ones, but shift each lane left with a multiply-low so the
+// sample ends up in the top bits, then clear the bits below it.
+
+TARGET_SSSE3 static void WidenLine10Ssse3(const uint8_t* in_ptr, int in_size, uint16_t* out_ptr, int count)
+{
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8);
+    const __m128i scale = _mm_setr_epi16(1, 1 << 2, 1 << 4, 1 << 6, 1, 1 << 2, 1 << 4, 1 << 6);
+    const __m128i high_bits = _mm_set1_epi16((short)0xFFC0);
+
+    int i = 0;
+    int offset = 0;
+    for (; i + 16 <= count && offset + 26 <= in_size; i += 16, offset += 20) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in_ptr + offset));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in_ptr + offset + 10));
+        a = _mm_and_si128(_mm_mullo_epi16(_mm_shuffle_epi8(a, shuffle), scale), high_bits);
+        b = _mm_and_si128(_mm_mullo_epi16(_mm_shuffle_epi8(b, shuffle), scale), high_bits);
+        _mm_storeu_si128((__m128i*)(out_ptr + i), a);
+        _mm_storeu_si128((__m128i*)(out_ptr + i + 8), b);
+    }
+    WidenSamples(in_ptr, 10, out_ptr, i, count);
+}
+
+TARGET_SSSE3 static void WidenLine12Ssse3(const uint8_t* in_ptr, int in_size, uint16_t* out_ptr, int count)
+{
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i scale = _mm_setr_epi16(1, 1 << 4, 1, 1 << 4, 1, 1 << 4, 1, 1 << 4);
+    const __m128i high_bits = _mm_set1_epi16((short)0xFFF0);
+
+    int i = 0;
+    int offset = 0;
+    for (; i + 16 <= count && offset + 28 <= in_size; i += 16, offset += 24) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in_ptr + offset));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in_ptr + offset + 12));
+        a = _mm_and_si128(_mm_mullo_epi16(_mm_shuffle_epi8(a, shuffle), scale), high_bits);
+        b = _mm_and_si128(_mm_mullo_epi16(_mm_shuffle_epi8(b, shuffle), scale), high_bits);
+        _mm_storeu_si128((__m128i*)(out_ptr + i), a);
+        _mm_storeu_si128((__m128i*)(out_ptr + i + 8), b);
+    }
+    WidenSamples(in_ptr, 12, out_ptr, i, count);
+}
+
+TARGET_SSSE3 static void SplitLineP216Ssse3(const uint16_t* in_ptr, uint16_t* y_ptr, uint16_t* uv_ptr, int width)
+{
+    // 4 pixels (8 samples) per load: Y0..Y3 to the low half, CB,CR pairs to the high half.
+    const __m128i shuffle = _mm_setr_epi8(2, 3, 6, 7, 10, 11, 14, 15, 0, 1, 4, 5, 8, 9, 12, 13);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i split = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in_ptr + x * 2)), shuffle);
+        _mm_storel_epi64((__m128i*)(y_ptr + x), split);
+        _mm_storel_epi64((__m128i*)(uv_ptr + x), _mm_unpackhi_epi64(split, split));
+    }
+    SplitLineP216Scalar(in_ptr + x * 2, y_ptr + x, uv_ptr + x, width - x);
+}
+
+TARGET_SSSE3 static void SplitLineP416Ssse3(const uint16_t* in_ptr, uint16_t* y_ptr, uint16_t* uv_ptr, int width)
+{
+    // 8 pixels (24 samples, 3 loads) per pass. Loads a, b and c hold samples 0-7, 8-15 and 16-23.
+    const __m128i y_a = _mm_setr_epi8(2, 3, 8, 9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i y_b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 4, 5, 10, 11, -1, -1, -1, -1, -1, -1);
+    const __m128i y_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 6, 7, 12, 13);
+    const __m128i uv_lo_a = _mm_setr_epi8(0, 1, 4, 5, 6, 7, 10, 11, 12, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i uv_lo_b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 2, 3, 6, 7);
+    const __m128i uv_hi_b = _mm_setr_epi8(8, 9, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i uv_hi_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 3, 4, 5, 8, 9, 10, 11, 14, 15);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const uint16_t* src_ptr = in_ptr + x * 3;
+        __m128i a = _mm_loadu_si128((const __m128i*)(src_ptr));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src_ptr + 8));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src_ptr + 16));
+        __m128i y = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, y_a), _mm_shuffle_epi8(b, y_b)),
+                                 _mm_shuffle_epi8(c, y_c));
+        __m128i uv_lo = _mm_or_si128(_mm_shuffle_epi8(a, uv_lo_a), _mm_shuffle_epi8(b, uv_lo_b));
+        __m128i uv_hi = _mm_or_si128(_mm_shuffle_epi8(b, uv_hi_b), _mm_shuffle_epi8(c, uv_hi_c));
+        _mm_storeu_si128((__m128i*)(y_ptr + x), y);
+        _mm_storeu_si128((__m128i*)(uv_ptr + x * 2), uv_lo);
+        _mm_storeu_si128((__m128i*)(uv_ptr + x * 2 + 8), uv_hi);
+    }
+    SplitLineP416Scalar(in_ptr + x * 3, y_ptr + x, uv_ptr + x * 2, width - x);
+}
+
+// The AVX2 narrowing kernels do the same as the SSSE3 ones with 32 samples per pass. The shuffle works within each
+// 128-bit lane, so every lane is loaded with its own 8 sample group. The pack interleaves lanes, which the final
+// permute undoes.
+
+TARGET_AVX2 static void NarrowLine10Avx2(const uint8_t* in_ptr, int in_size, uint8_t* out_ptr, int count)
+{
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8,
+                                             1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8);
+    const __m256i scale = _mm256_setr_epi16(1 << 8, 1 << 10, 1 << 12, 1 << 14, 1 << 8, 1 << 10, 1 << 12, 1 << 14,
+                                            1 << 8, 1 << 10, 1 << 12, 1 << 14, 1 << 8, 1 << 10, 1 << 12, 1 << 14);
+    const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+
+    int i = 0;
+    int offset = 0;
+    for (; i + 32 <= count && offset + 46 <= in_size; i += 32, offset += 40) {
+        const uint8_t* src_ptr = in_ptr + offset;
+        __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src_ptr))),
+                                            _mm_loadu_si128((const __m128i*)(src_ptr + 10)), 1);
+        __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src_ptr + 20))),
+                                            _mm_loadu_si128((const __m128i*)(src_ptr + 30)), 1);
+        a = _mm256_and_si256(_mm256_mulhi_epu16(_mm256_shuffle_epi8(a, shuffle), scale), low_byte);
+        b = _mm256_and_si256(_mm256_mulhi_epu16(_mm256_shuffle_epi8(b, shuffle), scale), low_byte);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out_ptr + i), packed);
+    }
+    NarrowSamples(in_ptr, 10, out_ptr, i, count);
+}
+
+TARGET_AVX2 static void NarrowLine12Avx2(const uint8_t* in_ptr, int in_size, uint8_t* out_ptr, int count)
+{
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i scale = _mm256_setr_epi16(1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12,
+                                            1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12);
+    const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+
+    int i = 0;
+    int offset = 0;
+    for (; i + 32 <= count && offset + 52 <= in_size; i += 32, offset += 48) {
+        const uint8_t* src_ptr = in_ptr + offset;
+        __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src_ptr))),
+                                            _mm_loadu_si128((const __m128i*)(src_ptr + 12)), 1);
+        __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src_ptr + 24))),
+                                            _mm_loadu_si128((const __m128i*)(src_ptr + 36)), 1);
+        a = _mm256_and_si256(_mm256_mulhi_epu16(_mm256_shuffle_epi8(a, shuffle), scale), low_byte);
+        b = _mm256_and_si256(_mm256_mulhi_epu16(_mm256_shuffle_epi8(b, shuffle), scale), low_byte);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out_ptr + i), packed);
+    }
+    NarrowSamples(in_ptr, 12, out_ptr, i, count);
+}
+
+/**
+ * @brief Check which SIMD extensions the CPU and OS support.
+ *
+ * @param ssse3_ptr Set to true if SSSE3 is supported.
+ * @param avx2_ptr Set to true if AVX2 is supported, including OS support for the YMM registers.
+ */
+static void DetectCpuFeatures(bool* ssse3_ptr, bool* avx2_ptr)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    *ssse3_ptr = (info[2] & (1 << 9)) != 0;
+    *avx2_ptr = false;
+    if (osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        *avx2_ptr = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    *ssse3_ptr = __builtin_cpu_supports("ssse3");
+    *avx2_ptr = __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // CDI_UNPACK_X86
+
+/**
+ * @brief Get the kernels to use, selecting them on first use.
+ *
+ * @return Reference to the selected kernel set.
+ */
+static const UnpackKernels& GetKernels()
+{
+    static UnpackKernels kernels = {
+        "scalar", NarrowLine10Scalar, NarrowLine12Scalar, SplitLine444Scalar, RgbLineScalar, AlphaLineScalar,
+        WidenLine10Scalar, WidenLine12Scalar, SplitLineP216Scalar, SplitLineP416Scalar
+    };
+    static std::once_flag once;
+
+    std::call_once(once, []() {
+#ifdef CDI_UNPACK_X86
+        bool ssse3 = false;
+        bool avx2 = false;
+        DetectCpuFeatures(&ssse3, &avx2);
+        if (ssse3) {
+            kernels = { "SSSE3", NarrowLine10Ssse3, NarrowLine12Ssse3, SplitLine444Ssse3, RgbLineSsse3,
+                        AlphaLineSsse3, WidenLine10Ssse3, WidenLine12Ssse3, SplitLineP216Ssse3,
+                        SplitLineP416Ssse3 };
+        }
+        if (ssse3 && avx2) {
+            kernels.name_str = "AVX2";
+            kernels.narrow_10bit = NarrowLine10Avx2;
+            kernels.narrow_12bit = NarrowLine12Avx2;
+        }
+#endif
+        blog(LOG_INFO, "Using %s kernels to unpack CDI video.", kernels.name_str);
+    });
+
+    return kernels;
+}
+
+/**
+ * @brief Get the number of bits per sample of a CDI bit depth.
+ */
+static int BitsPerSample(CdiAvmVideoBitDepth depth)
+{
+    if (kCdiAvmVidBitDepth10 == depth) {
+        return 10;
+    } else if (kCdiAvmVidBitDepth12 == depth) {
+        return 12;
+    }
+    return 8;
+}
+
+/**
+ * @brief Get a line of samples as 8-bit. Lines split across SGL entries are gathered first, and 10-bit and 12-bit
+ * lines are narrowed into a scratch line.
+ *
+ * @param kernels Kernels to use.
+ * @param reader Reader of the payload.
+ * @param offset Offset of the line in the payload.
+ * @param bits Bits per sample.
+ * @param count Number of samples in the line.
+ *
+ * @return Pointer to count 8-bit samples, or nullptr if the line is past the end of the payload.
+ */
+static const uint8_t* GetLine8(const UnpackKernels& kernels, CdiPayloadReader& reader, size_t offset, int bits,
+                               int count)
+{
+    // Conversion runs on the Rx worker thread of each receiver, so keep one set of scratch lines per thread.
+    thread_local std::vector<uint8_t> gather;
+    thread_local std::vector<uint8_t> scratch;
+
+    int in_size = count * bits / 8;
+    if (gather.size() < (size_t)in_size) {
+        gather.resize(in_size);
+    }
+    const uint8_t* in_ptr = reader.Read(offset, in_size, gather.data());
+    if (nullptr == in_ptr || 8 == bits) {
+        return in_ptr;
+    }
+
+    if (scratch.size() < (size_t)count) {
+        scratch.resize(count);
+    }
+    if (10 == bits) {
+        kernels.narrow_10bit(in_ptr, in_size, scratch.data(), count);
+    } else {
+        kernels.narrow_12bit(in_ptr, in_size, scratch.data(), count);
+    }
+    return scratch.data();
+}
+
+/**
+ * @brief Get a line of 10-bit or 12-bit samples widened to MSB aligned 16-bit. Lines split across SGL entries are
+ * gathered first.
+ *
+ * @param kernels Kernels to use.
+ * @param reader Reader of the payload.
+ * @param offset Offset of the line in the payload.
+ * @param bits Bits per sample, 10 or 12.
+ * @param count Number of samples in the line.
+ *
+ * @return Pointer to count 16-bit samples, or nullptr if the line is past the end of the payload.
+ */
+static const uint16_t* GetLine16(const UnpackKernels& kernels, CdiPayloadReader& reader, size_t offset, int bits,
+                                 int count)
+{
+    thread_local std::vector<uint8_t> gather;
+    thread_local std::vector<uint16_t> scratch;
+
+    int in_size = count * bits / 8;
+    if (gather.size() < (size_t)in_size) {
+        gather.resize(in_size);
+    }
+    const uint8_t* in_ptr = reader.Read(offset, in_size, gather.data());
+    if (nullptr == in_ptr) {
+        return nullptr;
+    }
+
+    if (scratch.size() < (size_t)count) {
+        scratch.resize(count);
+    }
+    if (10 == bits) {
+        kernels.widen_10bit(in_ptr, in_size, scratch.data(), count);
+    } else {
+        kernels.widen_12bit(in_ptr, in_size, scratch.data(), count);
+    }
+    return scratch.data();
+}
+
+/**
+ * @brief Get sample i of a packed line narrowed to 8-bit, which is the 8 most significant bits of the sample. These
+ * always are within the two bytes at the sample's first byte, whatever the bit depth.
+ *
+ * @param in_ptr Pointer to the packed line.
+ * @param bits Bits per sample.
+ * @param i Index of the sample.
+ *
+ * @return 8-bit sample.
+ */
+static inline uint8_t PickSample8(const uint8_t* in_ptr, int bits, int i)
+{
+    if (8 == bits) {
+        return in_ptr[i];
+    }
+    int bit_offset = i * bits;
+    const uint8_t* byte_ptr = in_ptr + (bit_offset >> 3);
+    uint16_t word = (uint16_t)((byte_ptr[0] << 8) | byte_ptr[1]);
+    return (uint8_t)(word >> (8 - (bit_offset & 7)));
+}
+
+/**
+ * @brief Get the packed line a decimated output line is picked from. Lines split across SGL entries are gathered.
+ *
+ * @param reader Reader of the payload.
+ * @param offset Offset of the line in the payload.
+ * @param in_linesize Size of the line in bytes.
+ *
+ * @return Pointer to the line, or nullptr if the line is past the end of the payload.
+ */
+static const uint8_t* GetPackedLine(CdiPayloadReader& reader, size_t offset, int in_linesize)
+{
+    thread_local std::vector<uint8_t> gather;
+    if (gather.size() < (size_t)in_linesize) {
+        gather.resize(in_linesize);
+    }
+    return reader.Read(offset, in_linesize, gather.data());
+}
+
+/**
+ * @brief Unpack a 10-bit or 12-bit YCbCr payload into a 16-bit Y plane and an interleaved 16-bit CbCr plane.
+ *
+ * @param split_fn Kernel that splits a widened line.
+ * @param samples_per_pixel Samples per pixel of the payload, 2 for 4:2:2 and 3 for 4:4:4.
+ */
+static bool UnpackToSemiPlanar16(SplitLine16Fn split_fn, int samples_per_pixel, uint8_t* planes[],
+                                 const uint32_t linesize[], int width, int height, CdiPayloadReader& reader,
+                                 CdiAvmVideoBitDepth depth, bool flip)
+{
+    const UnpackKernels& kernels = GetKernels();
+    int bits = BitsPerSample(depth);
+    if (8 == bits) {
+        return false;
+    }
+    int count = width * samples_per_pixel;
+    int in_linesize = count * bits / 8;
+
+    for (int y = 0; y < height; y++) {
+        int in_line = flip ? (height - 1 - y) : y;
+        const uint16_t* line_ptr = GetLine16(kernels, reader, (size_t)in_line * in_linesize, bits, count);
+        if (nullptr == line_ptr) {
+            return false;
+        }
+        split_fn(line_ptr, (uint16_t*)(planes[0] + (size_t)y * linesize[0]),
+                 (uint16_t*)(planes[1] + (size_t)y * linesize[1]), width);
+    }
+    return true;
+}
+
+//*********************************************************************************************************************
+//******************************************* START OF PUBLIC FUNCTIONS ***********************************************
+//*********************************************************************************************************************
+
+CdiPayloadReader::CdiPayloadReader(const uint8_t* payload_ptr, int payload_size)
+{
+    linear_entry = {};
+    linear_entry.address_ptr = (void*)payload_ptr;
+    linear_entry.size_in_bytes = payload_size;
+    head_ptr = &linear_entry;
+    entry_ptr = head_ptr;
+    entry_offset = 0;
+    total_size = payload_size;
+}
+
+CdiPayloadReader::CdiPayloadReader(const CdiSgList* sgl_ptr)
+{
+    linear_entry = {};
+    head_ptr = sgl_ptr->sgl_head_ptr;
+    entry_ptr = head_ptr;
+    entry_offset = 0;
+    total_size = sgl_ptr->total_data_size;
+}
+
+const uint8_t* CdiPayloadReader::Read(size_t offset, int size, uint8_t* scratch_ptr)
+{
+    if (offset + size > (size_t)total_size) {
+        return nullptr;
+    }
+
+    // Lines are mostly read in order, so carry on from the entry of the last read unless the range is before it.
+    if (offset < entry_offset) {
+        entry_ptr = head_ptr;
+        entry_offset = 0;
+    }
+    while (entry_ptr && offset >= entry_offset + (size_t)entry_ptr->size_in_bytes) {
+        entry_offset += entry_ptr->size_in_bytes;
+        entry_ptr = entry_ptr->next_ptr;
+    }
+    if (nullptr == entry_ptr) {
+        return nullptr;
+    }
+
+    int entry_pos = (int)(offset - entry_offset);
+    const uint8_t* src_ptr = (const uint8_t*)entry_ptr->address_ptr + entry_pos;
+    if (entry_pos + size <= entry_ptr->size_in_bytes) {
+        return src_ptr;
+    }
+
+    // The range continues in the following entries, which can split a pgroup at any byte, so gather it.
+    const CdiSglEntry* next_ptr = entry_ptr;
+    int available = next_ptr->size_in_bytes - entry_pos;
+    int copied = 0;
+    while (copied < size) {
+        int copy_size = (std::min)(available, size - copied);
+        memcpy(scratch_ptr + copied, src_ptr, copy_size);
+        copied += copy_size;
+
+        next_ptr = next_ptr->next_ptr;
+        if (nullptr == next_ptr) {
+            break;
+        }
+        src_ptr = (const uint8_t*)next_ptr->address_ptr;
+        available = next_ptr->size_in_bytes;
+    }
+    return (copied == size) ? scratch_ptr : nullptr;
+}
+
+const uint8_t* CdiPayloadReader::LinearData() const
+{
+    if (head_ptr && nullptr == head_ptr->next_ptr && head_ptr->size_in_bytes >= total_size) {
+        return (const uint8_t*)head_ptr->address_ptr;
+    }
+    return nullptr;
+}
+
+bool CdiUnpack422ToUyvy(uint8_t* uyvy_ptr, uint32_t linesize, int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool flip)
+{
+    const UnpackKernels& kernels = GetKernels();
+    int bits = BitsPerSample(depth);
+    int count = width * 2; // 2 samples per pixel.
+    int in_linesize = count * bits / 8;
+
+    thread_local std::vector<uint8_t> gather;
+    if (gather.size() < (size_t)in_linesize) {
+        gather.resize(in_linesize);
+    }
+
+    for (int y = 0; y < height; y++) {
+        int in_line = flip ? (height - 1 - y) : y;
+        uint8_t* out_ptr = uyvy_ptr + (size_t)y * linesize;
+
+        // CB,Y0,CR,Y1 narrowed to 8-bit is UYVY, so narrow straight into the output. 8-bit lines split across SGL
+        // entries are gathered straight into the output too.
+        const uint8_t* in_ptr = reader.Read((size_t)in_line * in_linesize, in_linesize,
+                                            (8 == bits) ? out_ptr : gather.data());
+        if (nullptr == in_ptr) {
+            return false;
+        }
+        if (10 == bits) {
+            kernels.narrow_10bit(in_ptr, in_linesize, out_ptr, count);
+        } else if (12 == bits) {
+            kernels.narrow_12bit(in_ptr, in_linesize, out_ptr, count);
+        } else if (in_ptr != out_ptr) {
+            memcpy(out_ptr, in_ptr, count);
+        }
+    }
+    return true;
+}
+
+bool CdiUnpack444ToI444(uint8_t* planes[], const uint32_t linesize[], int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool flip)
+{
+    const UnpackKernels& kernels = GetKernels();
+    int bits = BitsPerSample(depth);
+    int count = width * 3; // 3 samples per pixel.
+    int in_linesize = count * bits / 8;
+
+    for (int y = 0; y < height; y++) {
+        int in_line = flip ? (height - 1 - y) : y;
+        const uint8_t* line_ptr = GetLine8(kernels, reader, (size_t)in_line * in_linesize, bits, count);
+        if (nullptr == line_ptr) {
+            return false;
+        }
+        kernels.split_444(line_ptr, planes[0] + (size_t)y * linesize[0], planes[1] + (size_t)y * linesize[1],
+                          planes[2] + (size_t)y * linesize[2], width);
+    }
+    return true;
+}
+
+bool CdiUnpackRgbToBgra(uint8_t* bgra_ptr, uint32_t linesize, int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool alpha_used, bool flip)
+{
+    const UnpackKernels& kernels = GetKernels();
+    int bits = BitsPerSample(depth);
+    int count = width * 3;
+    int in_linesize = count * bits / 8;
+    int alpha_in_linesize = width * bits / 8;
+    // The alpha plane follows the RGB data.
+    size_t alpha_offset = (size_t)height * in_linesize;
+
+    for (int y = 0; y < height; y++) {
+        int in_line = flip ? (height - 1 - y) : y;
+        uint8_t* out_ptr = bgra_ptr + (size_t)y * linesize;
+
+        const uint8_t* line_ptr = GetLine8(kernels, reader, (size_t)in_line * in_linesize, bits, count);
+        if (nullptr == line_ptr) {
+            return false;
+        }
+        kernels.rgb_to_bgra(line_ptr, out_ptr, width);
+
+        if (alpha_used) {
+            line_ptr = GetLine8(kernels, reader, alpha_offset + (size_t)in_line * alpha_in_linesize, bits, width);
+            if (nullptr == line_ptr) {
+                return false;
+            }
+            kernels.insert_alpha(line_ptr, out_ptr, width);
+        }
+    }
+    return true;
+}
+
+bool CdiUnpack422ToP216(uint8_t* planes[], const uint32_t linesize[], int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool flip)
+{
+    return UnpackToSemiPlanar16(GetKernels().split_p216, 2, planes, linesize, width, height, reader, depth, flip);
+}
+
+bool CdiUnpack444ToP416(uint8_t* planes[], const uint32_t linesize[], int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool flip)
+{
+    return UnpackToSemiPlanar16(GetKernels().split_p416, 3, planes, linesize, width, height, reader, depth, flip);
+}
+
+bool CdiUnpack422ToUyvyDecimated(uint8_t* uyvy_ptr, uint32_t linesize, int width, int height, CdiPayloadReader& reader,
+                                 CdiAvmVideoBitDepth depth, int factor)
+{
+    int bits = BitsPerSample(depth);
+    int in_linesize = width * 2 * bits / 8;
+    int out_width = (width / factor) & ~1;
+    int out_height = height / factor;
+
+    for (int y = 0; y < out_height; y++) {
+        const uint8_t* in_ptr = GetPackedLine(reader, (size_t)y * factor * in_linesize, in_linesize);
+        if (nullptr == in_ptr) {
+            return false;
+        }
+        uint8_t* out_ptr = uyvy_ptr + (size_t)y * linesize;
+
+        // Output pixel x is input pixel x * factor. factor is even, so both pixels of an output pair are the first
+        // pixel of an input pair, whose Y is sample 1 and whose chroma the output pair shares.
+        for (int x = 0; x < out_width; x += 2) {
+            int first = x * factor * 2;
+            int second = (x + 1) * factor * 2;
+            out_ptr[0] = PickSample8(in_ptr, bits, first);      // CB
+            out_ptr[1] = PickSample8(in_ptr, bits, first + 1);  // Y0
+            out_ptr[2] = PickSample8(in_ptr, bits, first + 2);  // CR
+            out_ptr[3] = PickSample8(in_ptr, bits, second + 1); // Y1
+            out_ptr += 4;
+        }
+    }
+    return true;
+}
+
+bool CdiUnpack444ToI444Decimated(uint8_t* planes[], const uint32_t linesize[], int width, int height,
+                                 CdiPayloadReader& reader, CdiAvmVideoBitDepth depth, int factor)
+{
+    int bits = BitsPerSample(depth);
+    int in_linesize = width * 3 * bits / 8;
+    int out_width = width / factor;
+    int out_height = height / factor;
+
+    for (int y = 0; y < out_height; y++) {
+        const uint8_t* in_ptr = GetPackedLine(reader, (size_t)y * factor * in_linesize, in_linesize);
+        if (nullptr == in_ptr) {
+            return false;
+        }
+        uint8_t* y_ptr = planes[0] + (size_t)y * linesize[0];
+        uint8_t* u_ptr = planes[1] + (size_t)y * linesize[1];
+        uint8_t* v_ptr = planes[2] + (size_t)y * linesize[2];
+
+        // 4:4:4: CB,Y,CR (CB = U, CR= V, Y=Y)
+        for (int x = 0; x < out_width; x++) {
+            int i = x * factor * 3;
+            u_ptr[x] = PickSample8(in_ptr, bits, i);
+            y_ptr[x] = PickSample8(in_ptr, bits, i + 1);
+            v_ptr[x] = PickSample8(in_ptr, bits, i + 2);
+        }
+    }
+    return true;
+}
+
+bool CdiUnpackRgbToBgraDecimated(uint8_t* bgra_ptr, uint32_t linesize, int width, int height, CdiPayloadReader& reader,
+                                 CdiAvmVideoBitDepth depth, bool alpha_used, int factor)
+{
+    int bits = BitsPerSample(depth);
+    int in_linesize = width * 3 * bits / 8;
+    int alpha_in_linesize = width * bits / 8;
+    // The alpha plane follows the RGB data.
+    size_t alpha_offset = (size_t)height * in_linesize;
+    int out_width = width / factor;
+    int out_height = height / factor;
+
+    for (int y = 0; y < out_height; y++) {
+        const uint8_t* in_ptr = GetPackedLine(reader, (size_t)y * factor * in_linesize, in_linesize);
+        if (nullptr == in_ptr) {
+            return false;
+        }
+        uint8_t* out_ptr = bgra_ptr + (size_t)y * linesize;
+        for (int x = 0; x < out_width; x++) {
+            int i = x * factor * 3;
+            out_ptr[x * 4] = PickSample8(in_ptr, bits, i + 2);     // B
+            out_ptr[x * 4 + 1] = PickSample8(in_ptr, bits, i + 1); // G
+            out_ptr[x * 4 + 2] = PickSample8(in_ptr, bits, i);     // R
+            out_ptr[x * 4 + 3] = 0xFF;                             // A
+        }
+
+        if (alpha_used) {
+            in_ptr = GetPackedLine(reader, alpha_offset + (size_t)y * factor * alpha_in_linesize, alpha_in_linesize);
+            if (nullptr == in_ptr) {
+                return false;
+            }
+            for (int x = 0; x < out_width; x++) {
+                out_ptr[x * 4 + 3] = PickSample8(in_ptr, bits, x * factor);
+            }
+        }
+    }
+    return true;
+}
+
+const char* CdiUnpackKernelName(void)
+{
+    return GetKernels().name_str;
+}
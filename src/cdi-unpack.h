@@ -0,0 +1,220 @@
+/*
+-------------------------------------------------------------------------------------------
+  Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+
+  Licensed under the Apache License, Version 2.0 (the "License").
+  You may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+-------------------------------------------------------------------------------------------
+*/
+
+/**
+ * @file
+ * @brief
+ * This file contains the declarations of the functions that unpack received CDI video payloads into the planes
+ * handed to OBS. The best kernels the CPU supports are selected at runtime, and all of them produce output
+ * that is bit-exact with the scalar reference.
+*/
+
+#ifndef CDI_UNPACK_H
+#define CDI_UNPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+#include "cdi_core_api.h"
+#include "cdi_baseline_profile_02_00_api.h"
+};
+
+/**
+ * @brief Reads byte ranges of a received payload, which is either one linear buffer or a scatter-gather list (SGL)
+ * of SDK packet buffers. SGL entries can end at any byte, even within a pgroup.
+ */
+class CdiPayloadReader {
+public:
+    /// @brief Create a reader of a linear payload.
+    CdiPayloadReader(const uint8_t* payload_ptr, int payload_size);
+    /// @brief Create a reader of an SGL payload. The SGL must stay valid while the reader is used.
+    explicit CdiPayloadReader(const CdiSgList* sgl_ptr);
+    CdiPayloadReader(const CdiPayloadReader&) = delete;
+    CdiPayloadReader& operator=(const CdiPayloadReader&) = delete;
+
+    /**
+     * @brief Get size contiguous bytes at offset. Reads within one entry point straight into the payload, reads that
+     * span entries are gathered into scratch_ptr. Reading in increasing offset order is fastest.
+     *
+     * @param offset Offset in bytes from the start of the payload.
+     * @param size Number of bytes to read.
+     * @param scratch_ptr Buffer of at least size bytes to gather into if needed.
+     *
+     * @return Pointer to the bytes, or nullptr if the range is past the end of the payload.
+     */
+    const uint8_t* Read(size_t offset, int size, uint8_t* scratch_ptr);
+
+    /// @brief Get the payload as one contiguous buffer, or nullptr if it is split across SGL entries.
+    const uint8_t* LinearData() const;
+
+    /// @brief Total size of the payload in bytes.
+    int Size() const { return total_size; }
+
+private:
+    CdiSglEntry linear_entry;      ///< Entry describing a linear payload.
+    const CdiSglEntry* head_ptr;   ///< First entry of the payload.
+    const CdiSglEntry* entry_ptr;  ///< Entry of the last read.
+    size_t entry_offset;           ///< Offset in the payload of entry_ptr.
+    int total_size;                ///< Total size of the payload in bytes.
+};
+
+/**
+ * @brief Unpack a CDI YCbCr 4:2:2 payload into packed 8-bit UYVY. 8-bit payloads already are UYVY, so callers with a
+ * linear payload that do not need to flip can use it as is instead.
+ *
+ * @param uyvy_ptr Pointer to the output image.
+ * @param linesize Line size in bytes of the output image.
+ * @param width Width of the frame in pixels. Must be a multiple of 2.
+ * @param height Height of the frame in lines.
+ * @param reader Reader of the CDI payload data.
+ * @param depth Bit depth of the CDI payload.
+ * @param flip true to flip the image vertically.
+ *
+ * @return true if successful, false if the payload is too small for the frame.
+ */
+bool CdiUnpack422ToUyvy(uint8_t* uyvy_ptr, uint32_t linesize, int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool flip);
+
+/**
+ * @brief Unpack a CDI YCbCr 4:4:4 payload into three 8-bit planes (I444).
+ *
+ * @param planes Y, U and V output planes.
+ * @param linesize Line size in bytes of each output plane.
+ * @param width Width of the frame in pixels. Must be a multiple of the pgroup size of the bit depth.
+ * @param height Height of the frame in lines.
+ * @param reader Reader of the CDI payload data.
+ * @param depth Bit depth of the CDI payload.
+ * @param flip true to flip the image vertically.
+ *
+ * @return true if successful, false if the payload is too small for the frame.
+ */
+bool CdiUnpack444ToI444(uint8_t* planes[], const uint32_t linesize[], int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool flip);
+
+/**
+ * @brief Unpack a CDI RGB payload, and its alpha plane if used, into packed 8-bit BGRA.
+ *
+ * @param bgra_ptr Pointer to the output image.
+ * @param linesize Line size in bytes of the output image.
+ * @param width Width of the frame in pixels. Must be a multiple of the pgroup size of the bit depth.
+ * @param height Height of the frame in lines.
+ * @param reader Reader of the CDI payload data.
+ * @param depth Bit depth of the CDI payload.
+ * @param alpha_used true if the payload is followed by an alpha plane, otherwise alpha is set to 0xFF.
+ * @param flip true to flip the image vertically.
+ *
+ * @return true if successful, false if the payload is too small for the frame.
+ */
+bool CdiUnpackRgbToBgra(uint8_t* bgra_ptr, uint32_t linesize, int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool alpha_used, bool flip);
+
+/**
+ * @brief Unpack a 10-bit or 12-bit CDI YCbCr 4:2:2 payload into P216: a 16-bit Y plane and an interleaved 16-bit
+ * CbCr plane, with each sample in the most significant bits.
+ *
+ * @param planes Y and CbCr output planes.
+ * @param linesize Line size in bytes of each output plane.
+ * @param width Width of the frame in pixels. Must be a multiple of the pgroup size of the bit depth.
+ * @param height Height of the frame in lines.
+ * @param reader Reader of the CDI payload data.
+ * @param depth Bit depth of the CDI payload, 10-bit or 12-bit.
+ * @param flip true to flip the image vertically.
+ *
+ * @return true if successful, false if the payload is too small for the frame or is 8-bit.
+ */
+bool CdiUnpack422ToP216(uint8_t* planes[], const uint32_t linesize[], int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool flip);
+
+/**
+ * @brief Unpack a 10-bit or 12-bit CDI YCbCr 4:4:4 payload into P416: a 16-bit Y plane and an interleaved 16-bit
+ * CbCr plane, with each sample in the most significant bits.
+ *
+ * @param planes Y and CbCr output planes.
+ * @param linesize Line size in bytes of each output plane.
+ * @param width Width of the frame in pixels. Must be a multiple of the pgroup size of the bit depth.
+ * @param height Height of the frame in lines.
+ * @param reader Reader of the CDI payload data.
+ * @param depth Bit depth of the CDI payload, 10-bit or 12-bit.
+ * @param flip true to flip the image vertically.
+ *
+ * @return true if successful, false if the payload is too small for the frame or is 8-bit.
+ */
+bool CdiUnpack444ToP416(uint8_t* planes[], const uint32_t linesize[], int width, int height, CdiPayloadReader& reader,
+                        CdiAvmVideoBitDepth depth, bool flip);
+
+/**
+ * @brief Unpack a CDI YCbCr 4:2:2 payload into packed 8-bit UYVY at 1/factor of its width and height, for proxies.
+ *
+ * @param uyvy_ptr Pointer to the output image of (width / factor) rounded down to a multiple of 2 by height / factor
+ * pixels.
+ * @param linesize Line size in bytes of the output image.
+ * @param width Width of the payload in pixels.
+ * @param height Height of the payload in lines.
+ * @param reader Reader of the CDI payload data.
+ * @param depth Bit depth of the CDI payload.
+ * @param factor Decimation factor, 2 or 4.
+ *
+ * @return true if successful, false if the payload is too small for the frame.
+ */
+bool CdiUnpack422ToUyvyDecimated(uint8_t* uyvy_ptr, uint32_t linesize, int width, int height, CdiPayloadReader& reader,
+                                 CdiAvmVideoBitDepth depth, int factor);
+
+/**
+ * @brief Unpack a CDI YCbCr 4:4:4 payload into three 8-bit planes (I444) at 1/factor of its width and height, for
+ * proxies.
+ *
+ * @param planes Y, U and V output planes of width / factor by height / factor pixels.
+ * @param linesize Line size in bytes of each output plane.
+ * @param width Width of the payload in pixels.
+ * @param height Height of the payload in lines.
+ * @param reader Reader of the CDI payload data.
+ * @param depth Bit depth of the CDI payload.
+ * @param factor Decimation factor, 2 or 4.
+ *
+ * @return true if successful, false if the payload is too small for the frame.
+ */
+bool CdiUnpack444ToI444Decimated(uint8_t* planes[], const uint32_t linesize[], int width, int height,
+                                 CdiPayloadReader& reader, CdiAvmVideoBitDepth depth, int factor);
+
+/**
+ * @brief Unpack a CDI RGB payload, and its alpha plane if used, into packed 8-bit BGRA at 1/factor of its width and
+ * height, for proxies.
+ *
+ * @param bgra_ptr Pointer to the output image of width / factor by height / factor pixels.
+ * @param linesize Line size in bytes of the output image.
+ * @param width Width of the payload in pixels.
+ * @param height Height of the payload in lines.
+ * @param reader Reader of the CDI payload data.
+ * @param depth Bit depth of the CDI payload.
+ * @param alpha_used true if the payload is followed by an alpha plane, otherwise alpha is set to 0xFF.
+ * @param factor Decimation factor, 2 or 4.
+ *
+ * @return true if successful, false if the payload is too small for the frame.
+ */
+bool CdiUnpackRgbToBgraDecimated(uint8_t* bgra_ptr, uint32_t linesize, int width, int height, CdiPayloadReader& reader,
+                                 CdiAvmVideoBitDepth depth, bool alpha_used, int factor);
+
+/**
+ * @brief Get the name of the unpack kernels selected for this CPU.
+ *
+ * @return "scalar", "SSSE3" or "AVX2".
+ */
+const char* CdiUnpackKernelName(void);
+
+#endif // CDI_UNPACK_H
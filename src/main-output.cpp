@@ -22,6 +22,7 @@
 #include <util/platform.h>
 
 #include "obs-cdi.h"
+#include "Config.h"
 
 static obs_output_t* main_out = nullptr;
 static bool main_output_running = false;
@@ -31,11 +32,29 @@ void main_output_init(const char* default_name)
 	if (main_out) return;
 
 	obs_data_t* settings = obs_data_create();
-	obs_data_set_string(settings, "cdi_name", default_name);
+	obs_data_set_string(settings, OUTPUT_PROP_NAME, default_name);
 	main_out = obs_output_create("cdi_output", "CDI Main Output", settings, nullptr);
 	obs_data_release(settings);
 }
 
+/**
+ * @brief Copy the main output configuration into the settings of the output. The output itself does not know about
+ * the frontend configuration, so hand it everything it needs.
+ */
+static void set_output_settings(obs_data_t* settings, const char* output_name)
+{
+	Config* conf = Config::Current();
+	obs_data_set_string(settings, OUTPUT_PROP_NAME, output_name);
+	obs_data_set_string(settings, OUTPUT_PROP_LOCAL_IP, conf->OutputIP.toUtf8().constData());
+	obs_data_set_string(settings, OUTPUT_PROP_DEST_IP, conf->OutputDest.toUtf8().constData());
+	obs_data_set_int(settings, OUTPUT_PROP_DEST_PORT, conf->OutputPort);
+	obs_data_set_int(settings, OUTPUT_PROP_VIDEO_STREAM_ID, conf->OutputVideoStreamId);
+	obs_data_set_int(settings, OUTPUT_PROP_AUDIO_STREAM_ID, conf->OutputAudioStreamId);
+	obs_data_set_int(settings, OUTPUT_PROP_VIDEO_SAMPLING, conf->OutputVideoSampling);
+	obs_data_set_bool(settings, OUTPUT_PROP_ALPHA_USED, conf->OutputAlphaUsed);
+	obs_data_set_int(settings, OUTPUT_PROP_BIT_DEPTH, conf->OutputBitDepth);
+}
+
 void main_output_start(const char* output_name)
 {
 	if (main_output_running || !main_out) return;
@@ -43,7 +62,7 @@ void main_output_start(const char* output_name)
 	blog(LOG_INFO, "starting CDI main output with name '%s'", output_name);
 
 	obs_data_t* settings = obs_output_get_settings(main_out);
-	obs_data_set_string(settings, "cdi_name", output_name);
+	set_output_settings(settings, output_name);
 	obs_output_update(main_out, settings);
 	obs_data_release(settings);
 
@@ -51,13 +70,42 @@ void main_output_start(const char* output_name)
 	main_output_running = true;
 }
 
+void main_output_update(const char* output_name)
+{
+	if (!main_output_running || !main_out) return;
+
+	obs_data_t* settings = obs_output_get_settings(main_out);
+	bool restart = (0 != strcmp(obs_data_get_string(settings, OUTPUT_PROP_LOCAL_IP),
+		Config::Current()->OutputIP.toUtf8().constData()));
+
+	if (restart) {
+		// A different adapter is needed, which the output only picks up when started.
+		obs_data_release(settings);
+		main_output_stop();
+		main_output_start(output_name);
+		return;
+	}
+
+	// The output applies the differences itself, without restarting.
+	blog(LOG_INFO, "updating CDI main output");
+	set_output_settings(settings, output_name);
+	obs_output_update(main_out, settings);
+	obs_data_release(settings);
+}
+
 void main_output_stop()
 {
 	if (!main_output_running) return;
 
 	blog(LOG_INFO, "stopping CDI main output");
 
-	obs_output_stop(main_out);
+	// Data capture only begins once the CDI receiver first connects. Until then OBS does not consider the output
+	// active, and obs_output_stop() would not call into the output to stop it.
+	if (obs_output_active(main_out)) {
+		obs_output_stop(main_out);
+	} else {
+		obs_output_force_stop(main_out);
+	}
 	main_output_running = false;
 }
 
@@ -26,11 +26,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include "Config.h"
-#include "obs-frontend-api.h"
-#include <util/config-file.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <string>
+#include <thread>
 
 extern "C" {
 #include "obs-cdi.h"
@@ -55,13 +57,16 @@ extern "C" {
 // @brief Default timeout in milliseconds for sending CDI payloads.
 #define DEFAULT_TIMEOUT                (20000)
 
+// @brief Maximum time in milliseconds that stopping waits for payloads in flight before destroying the connection.
+#define DRAIN_TIMEOUT_MS               (500)
+
 /**
  * @brief A structure that holds all the settings.
  */
 struct TestSettings {
-    const char* local_adapter_ip_str;  ///< The local network adapter IP address.
+    std::string local_adapter_ip_str;  ///< The local network adapter IP address.
     int dest_port;                     ///< The destination port number.
-    const char* remote_adapter_ip_str; ///< The remote network adapter IP address.
+    std::string remote_adapter_ip_str; ///< The remote network adapter IP address.
     int rate_numerator;                ///< The numerator for the number of payloads per second to send.
     int rate_denominator;              ///< The denominator for the number of payloads per second to send.
     int tx_timeout;                    ///< The transmit timeout in microseconds for a Tx payload.
@@ -80,7 +85,7 @@ struct TestSettings {
 struct TestConnectionInfo {
     CdiConnectionHandle connection_handle; ///< The connection handle returned by CdiRawTxCreate().
 
-    TestSettings test_settings{0};         ///< Test settings data structure provided by the user.
+    TestSettings test_settings{};          ///< Test settings data structure provided by the user.
 
     volatile bool payload_error;           ///< true if Tx callback got a payload error.
 
@@ -95,16 +100,27 @@ struct TestConnectionInfo {
     uint32_t payload_cb_count;
 };
 
+struct TestTxUserData;
+
+/// @brief Converts an OBS video frame into the payload buffer of a pool item. Returns true if the frame can be sent.
+typedef bool (*VideoConvertFn)(TestTxUserData* user_data_ptr, struct video_data* frame);
+
 // This is the structure that holds things about our audio and video including the buffers we will later use
 // for manipulation of the data.
 struct cdi_output
 {
     std::mutex connection_mutex;
     obs_output_t* output;
-    const char* cdi_name;
+    std::string cdi_name;      ///< Name of the output while it is started.
+    std::string settings_name; ///< Name of the output from the output's obs_data.
     bool uses_video;
     bool uses_audio;
-    bool started;
+    TestSettings settings{};   ///< Settings from the output's obs_data. Copied to con_info when the output starts.
+    std::string output_address_str; ///< Local IP addresses given to NetworkAdapterAddOutputAddress().
+    std::atomic<bool> started{false}; ///< true from a successful cdi_output_start() until cdi_output_stop().
+    std::mutex capture_mutex;  ///< Serializes beginning OBS data capture in the connection callback against stopping.
+    uint32_t capture_flags;    ///< OBS_OUTPUT_VIDEO/OBS_OUTPUT_AUDIO flags to use when beginning data capture.
+    bool capturing;            ///< true once OBS data capture has begun. Uses capture_mutex.
     uint32_t frame_width;
     uint32_t frame_height;
     const char* frame_type;
@@ -120,6 +136,28 @@ struct cdi_output
 
     CdiAvmConfig avm_audio_config{0};
     int audio_unit_size;
+
+    CdiAdapterHandle adapter_handle;   ///< Adapter used by the connection, nullptr if not acquired.
+    uint8_t* tx_buffer_ptr;            ///< Region of the adapter Tx buffer that backs the payload pool.
+    int tx_payload_size;               ///< Size in bytes of each payload buffer in the pool.
+
+    std::atomic<bool> draining{false}; ///< true from stop until the connection has been torn down.
+    std::atomic<int> payloads_in_flight{0}; ///< Payloads handed to the SDK that have not completed yet.
+    std::mutex drain_mutex;            ///< Used with drain_cv.
+    std::condition_variable drain_cv;  ///< Signaled when payloads_in_flight drops to zero.
+    std::thread teardown_thread;       ///< Tears down the connection after stop. See cdi_output_stop().
+
+    VideoConvertFn video_convert_fn;   ///< Conversion for the video format in con_info.test_settings.
+    bool video_format_pending;         ///< true if pending_video_settings is applied at the next video frame.
+    TestSettings pending_video_settings{}; ///< Video format to switch to. See ApplyVideoFormat().
+};
+
+/**
+ * @brief Context used to initialize the items of the Tx payload pool. See InitPoolItem().
+ */
+struct TxPoolInitContext {
+    uint8_t* buffer_ptr; ///< Next unused byte of the connection's Tx buffer region.
+    int item_size;       ///< Size in bytes of the payload buffer of each pool item.
 };
 
 /**
@@ -131,6 +169,10 @@ struct TestTxUserData {
     CdiSglEntry sgl_entry; // Single SGL entry for the payload (linear buffer format).
 };
 
+static bool ObsToCdi422VideoFrame(TestTxUserData* user_data_ptr, struct video_data* frame);
+static bool ObsToCdi444VideoFrame(TestTxUserData* user_data_ptr, struct video_data* frame);
+static bool ObsToCdiRgbVideoFrame(TestTxUserData* user_data_ptr, struct video_data* frame);
+
 // Output 5 bytes of CDI 10-bit pixel data.
 #define CDI_10_BIT_OUT_5_BYTES(OUT, A0, B0, C0, A1) \
         *(OUT++) = (uint8_t)(A0 >> 2);                      /* A0 bits 9-2 */ \
@@ -152,14 +194,14 @@ struct TestTxUserData {
 /**
  * @brief Initialize a pool memory item.
  * 
- * @param context_ptr Pointer to user defined parameter (a pointer to a buffer pointer).
+ * @param context_ptr Pointer to user defined parameter (a pointer to a TxPoolInitContext).
  * @param item_ptr Pointer to the new pool item to initialize.
  *
  * @return Always returns true.
  */
 static bool InitPoolItem(const void* context_ptr, void* item_ptr)
 {
-    uint8_t** buffer_ptr = (uint8_t**)context_ptr;
+    TxPoolInitContext* context = (TxPoolInitContext*)context_ptr;
     TestTxUserData* user_ptr = (TestTxUserData*)item_ptr;
 
     memset(user_ptr, 0, sizeof(*user_ptr));
@@ -169,15 +211,37 @@ static bool InitPoolItem(const void* context_ptr, void* item_ptr)
     user_ptr->sglist.sgl_tail_ptr = user_ptr->sglist.sgl_head_ptr;
 
     // Initialize SGL entry.
-    user_ptr->sgl_entry.address_ptr = *buffer_ptr;
-    user_ptr->sgl_entry.size_in_bytes = MAX_PAYLOAD_SIZE;
+    user_ptr->sgl_entry.address_ptr = context->buffer_ptr;
+    user_ptr->sgl_entry.size_in_bytes = context->item_size;
 
     // Adjust buffer pointer for next item's use.
-    *buffer_ptr += MAX_PAYLOAD_SIZE;
+    context->buffer_ptr += context->item_size;
 
     return true;
 }
 
+/**
+ * Begin OBS data capture once the receiver has connected for the first time. Until then there is nothing to send, so
+ * OBS does not do the GPU readback and raw callbacks. Capture then stays active through later disconnects, since
+ * ending it makes OBS signal that the output stopped, and frontends would see it stop and start on every blip.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ */
+static void BeginDataCaptureOnConnect(cdi_output* cdi_ptr)
+{
+    std::lock_guard<std::mutex> guard(cdi_ptr->capture_mutex);
+
+    if (!cdi_ptr->started || cdi_ptr->capturing ||
+        kCdiConnectionStatusConnected != cdi_ptr->con_info.connection_status) {
+        return;
+    }
+    blog(LOG_INFO, "'%s': CDI connected. Beginning data capture.", cdi_ptr->cdi_name.c_str());
+    cdi_ptr->capturing = obs_output_begin_data_capture(cdi_ptr->output, cdi_ptr->capture_flags);
+    if (!cdi_ptr->capturing) {
+        blog(LOG_ERROR, "'%s': Failed to begin data capture.", cdi_ptr->cdi_name.c_str());
+    }
+}
+
 /**
  * Handle the connection callback.
  *
@@ -188,8 +252,17 @@ static void TestConnectionCallback(const CdiCoreConnectionCbData* cb_data_ptr)
     cdi_output* cdi_ptr = (cdi_output*)cb_data_ptr->connection_user_cb_param;
 
     // Update connection state and set state change signal.
+    CdiConnectionStatus old_status = cdi_ptr->con_info.connection_status;
     cdi_ptr->con_info.connection_status = cb_data_ptr->status_code;
     CdiOsSignalSet(cdi_ptr->con_info.connection_state_change_signal);
+
+    // After the first connect, cdi_output_rawvideo() and cdi_output_rawaudio() drop the frames while the receiver is
+    // away. See BeginDataCaptureOnConnect().
+    if (cdi_ptr->started && old_status != cb_data_ptr->status_code &&
+        kCdiConnectionStatusConnected != cb_data_ptr->status_code) {
+        blog(LOG_INFO, "'%s': CDI disconnected. Dropping frames until reconnected.", cdi_ptr->cdi_name.c_str());
+    }
+    BeginDataCaptureOnConnect(cdi_ptr);
 }
 
 /**
@@ -208,7 +281,13 @@ static void TestAvmTxCallback(const CdiAvmTxCbData* cb_data_ptr)
     }
 
     // Return user data to memory pool.
-    CdiPoolPut(user_data_ptr->cdi_ptr->con_info.tx_user_data_pool_handle, user_data_ptr);
+    cdi_output* cdi_ptr = user_data_ptr->cdi_ptr;
+    CdiPoolPut(cdi_ptr->con_info.tx_user_data_pool_handle, user_data_ptr);
+
+    if (1 == cdi_ptr->payloads_in_flight.fetch_sub(1)) {
+        std::lock_guard<std::mutex> guard(cdi_ptr->drain_mutex);
+        cdi_ptr->drain_cv.notify_all();
+    }
 }
 
 /**
@@ -346,15 +425,297 @@ static bool SendAvmPayload(TestTxUserData* user_data_ptr, CdiPtpTimestamp* times
     payload_config.core_config_data.unit_size = unit_size;
     payload_config.avm_extra_data.stream_identifier = (uint16_t)stream_identifier;
 
-    // Send the payload, retrying if the queue is full.
+    cdi_output* cdi_ptr = user_data_ptr->cdi_ptr;
+    cdi_ptr->payloads_in_flight++;
+
+    // Send the payload, retrying if the queue is full unless the output is being stopped.
     do {
-        rs = CdiAvmTxPayload(user_data_ptr->cdi_ptr->con_info.connection_handle, &payload_config, avm_config_ptr,
-                             &user_data_ptr->sglist, user_data_ptr->cdi_ptr->con_info.test_settings.tx_timeout);
-    } while (kCdiStatusQueueFull == rs);
+        rs = CdiAvmTxPayload(cdi_ptr->con_info.connection_handle, &payload_config, avm_config_ptr,
+                             &user_data_ptr->sglist, cdi_ptr->con_info.test_settings.tx_timeout);
+    } while (kCdiStatusQueueFull == rs && !cdi_ptr->draining);
 
+    if (kCdiStatusOk != rs) {
+        cdi_ptr->payloads_in_flight--; // No callback is made for the payload.
+    }
     return kCdiStatusOk == rs;
 }
 
+/**
+ * Get the size of the payload buffers needed by the started output, so only that much of the adapter's Tx buffer is
+ * taken from the adapter. Must be called after the frame size and audio format have been set in cdi_ptr.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ * @param settings_ptr Pointer to the settings holding the video format.
+ *
+ * @return Size in bytes of the largest payload.
+ */
+static int GetTxPayloadSize(const cdi_output* cdi_ptr, const TestSettings* settings_ptr)
+{
+    int video_size = 0;
+    int audio_size = 0;
+
+    if (cdi_ptr->frame_width && cdi_ptr->frame_height) {
+        int components = 2; // 4:2:2
+        if (kCdiAvmVidYCbCr444 == settings_ptr->video_sampling) {
+            components = 3;
+        } else if (kCdiAvmVidRGB == settings_ptr->video_sampling) {
+            components = settings_ptr->alpha_used ? 4 : 3;
+        }
+        int bits = 8;
+        if (kCdiAvmVidBitDepth10 == settings_ptr->bit_depth) {
+            bits = 10;
+        } else if (kCdiAvmVidBitDepth12 == settings_ptr->bit_depth) {
+            bits = 12;
+        }
+        video_size = (int)(((uint64_t)cdi_ptr->frame_width * cdi_ptr->frame_height * components * bits + 7) / 8);
+    }
+    if (cdi_ptr->audio_channels) {
+        audio_size = cdi_ptr->audio_channels * AUDIO_OUTPUT_FRAMES * CDI_BYTES_PER_AUDIO_SAMPLE;
+    }
+
+    // Round up, so each payload buffer starts on a cache line.
+    return (MAX(video_size, audio_size) + 63) & ~63;
+}
+
+/**
+ * Check that OBS produces frames in the pixel format needed by a CDI video sampling.
+ *
+ * @param sampling The CDI video sampling.
+ * @param format The OBS video format.
+ *
+ * @return true if the format can be converted to the sampling.
+ */
+static bool IsVideoFormatSupported(CdiAvmVideoSampling sampling, video_format format)
+{
+    if (kCdiAvmVidRGB == sampling) {
+        if (VIDEO_FORMAT_BGRA != format) {
+            blog(LOG_ERROR, "For RGB output, OSB Studio pixel format must be BGRA. [%d] is not supported.", format);
+            return false;
+        }
+    } else {
+        // 4:2:2 and 4:4:4.
+        if (VIDEO_FORMAT_I444 != format) {
+            blog(LOG_ERROR, "For YCbCr output, OSB Studio pixel format must be I444. [%d] is not supported.", format);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Select the conversion used by cdi_output_rawvideo() for the video sampling in con_info.test_settings.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ */
+static void SelectVideoConverter(cdi_output* cdi_ptr)
+{
+    switch (cdi_ptr->con_info.test_settings.video_sampling) {
+        case kCdiAvmVidYCbCr422:
+            cdi_ptr->video_convert_fn = ObsToCdi422VideoFrame;
+            break;
+        case kCdiAvmVidYCbCr444:
+            cdi_ptr->video_convert_fn = ObsToCdi444VideoFrame;
+            break;
+        case kCdiAvmVidRGB:
+            cdi_ptr->video_convert_fn = ObsToCdiRgbVideoFrame;
+            break;
+        default:
+            cdi_ptr->video_convert_fn = nullptr;
+            break;
+    }
+}
+
+/**
+ * Switch the started output to another video format. Rebuilds the AVM video configuration and selects the matching
+ * conversion. Must be called with connection_mutex held, between two video frames.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ * @param settings_ptr Pointer to the settings holding the new video format.
+ */
+static void ApplyVideoFormat(cdi_output* cdi_ptr, const TestSettings* settings_ptr)
+{
+    TestSettings* current_ptr = &cdi_ptr->con_info.test_settings;
+    current_ptr->video_sampling = settings_ptr->video_sampling;
+    current_ptr->alpha_used = settings_ptr->alpha_used;
+    current_ptr->bit_depth = settings_ptr->bit_depth;
+
+    video_t* video = obs_output_video(cdi_ptr->output);
+    if (video) {
+        MakeVideoConfig(&cdi_ptr->con_info, &cdi_ptr->avm_video_config, &cdi_ptr->video_unit_size, video);
+    }
+    SelectVideoConverter(cdi_ptr);
+    cdi_ptr->video_format_pending = false;
+
+    blog(LOG_INFO, "'%s': Video format changed to sampling[%d] bit depth[%d].", cdi_ptr->cdi_name.c_str(),
+         current_ptr->video_sampling, current_ptr->bit_depth);
+}
+
+/**
+ * Take the part of the adapter's Tx buffer that the connection needs and create the payload pool on it. Only what
+ * the format needs is taken, so other outputs can share the adapter. The reference to the adapter is taken again,
+ * initializing the adapter if needed, so no connection of the output may use it.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ *
+ * @return kCdiStatusOk if successful, otherwise kCdiStatusNotEnoughMemory.
+ */
+static CdiReturnStatus CreateTxPool(cdi_output* cdi_ptr)
+{
+    cdi_ptr->tx_payload_size = GetTxPayloadSize(cdi_ptr, &cdi_ptr->con_info.test_settings);
+
+    // Released first, so if this output was its only user, an adapter whose Tx buffer is too small for the new format
+    // can be initialized again with a larger one. Otherwise the adapter is reused, as it stays initialized while idle.
+    if (cdi_ptr->adapter_handle) {
+        NetworkAdapterDestroy(cdi_ptr->adapter_handle);
+    }
+    void* tx_buffer_ptr = nullptr;
+    cdi_ptr->adapter_handle = NetworkAdapterInitialize(cdi_ptr->con_info.test_settings.local_adapter_ip_str.c_str(),
+                                                       (size_t)cdi_ptr->tx_payload_size * MAX_NUMBER_OF_TX_PAYLOADS,
+                                                       &tx_buffer_ptr);
+    cdi_ptr->tx_buffer_ptr = (uint8_t*)tx_buffer_ptr;
+    if (nullptr == cdi_ptr->tx_buffer_ptr) {
+        return kCdiStatusNotEnoughMemory;
+    }
+
+    TxPoolInitContext init_context = { cdi_ptr->tx_buffer_ptr, cdi_ptr->tx_payload_size };
+    if (!CdiPoolCreateAndInitItems("TestTxUserData Pool", MAX_NUMBER_OF_TX_PAYLOADS, 0, 0, sizeof(TestTxUserData),
+        true, // true= Make thread-safe (use OS resource locks)
+        &cdi_ptr->con_info.tx_user_data_pool_handle,
+        InitPoolItem,
+        &init_context)) {
+        return kCdiStatusNotEnoughMemory;
+    }
+    return kCdiStatusOk;
+}
+
+/**
+ * Destroy the payload pool and give its memory back to the adapter. No payloads may be in flight.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ */
+static void DestroyTxPool(cdi_output* cdi_ptr)
+{
+    if (cdi_ptr->con_info.tx_user_data_pool_handle) {
+        CdiPoolPutAll(cdi_ptr->con_info.tx_user_data_pool_handle);
+        CdiPoolDestroy(cdi_ptr->con_info.tx_user_data_pool_handle);
+        cdi_ptr->con_info.tx_user_data_pool_handle = nullptr;
+    }
+    if (cdi_ptr->tx_buffer_ptr) {
+        NetworkAdapterTxBufferFree(cdi_ptr->adapter_handle, cdi_ptr->tx_buffer_ptr);
+        cdi_ptr->tx_buffer_ptr = nullptr;
+    }
+    cdi_ptr->tx_payload_size = 0;
+}
+
+/**
+ * Create the AVM Tx connection to the destination in con_info.test_settings.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ *
+ * @return The status returned by CdiAvmTxCreate().
+ */
+static CdiReturnStatus CreateTxConnection(cdi_output* cdi_ptr)
+{
+    CdiTxConfigData config_data = { 0 };
+    config_data.adapter_handle = cdi_ptr->adapter_handle;
+    config_data.dest_ip_addr_str = cdi_ptr->con_info.test_settings.remote_adapter_ip_str.c_str();
+    config_data.dest_port = cdi_ptr->con_info.test_settings.dest_port;
+    config_data.thread_core_num = -1; // -1= Let OS decide which CPU core to use.
+    config_data.connection_log_method_data_ptr = &log_method_data;
+    config_data.connection_cb_ptr = TestConnectionCallback;
+    config_data.connection_user_cb_param = cdi_ptr;
+    config_data.stats_config.disable_cloudwatch_stats = true;
+
+    blog(LOG_INFO, "Creating AVM Tx connection.");
+    blog(LOG_INFO, "Local IP: [%s]", cdi_ptr->con_info.test_settings.local_adapter_ip_str.c_str());
+    blog(LOG_INFO, "Remote: [%s:%d]", config_data.dest_ip_addr_str, config_data.dest_port);
+
+    return CdiAvmTxCreate(&config_data, TestAvmTxCallback, &cdi_ptr->con_info.connection_handle);
+}
+
+/**
+ * Replace the connection of the started output with a new one, keeping the adapter. Used when the destination
+ * changes, or when a new video format does not fit in the payload buffers.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ * @param new_settings_ptr Pointer to the settings holding the new destination and video format.
+ * @param rebuild_pool true to also rebuild the payload pool for the new video format.
+ *
+ * @return true if the new connection was created. If not, the output has no connection and must be stopped.
+ */
+static bool RecreateConnection(cdi_output* cdi_ptr, const TestSettings* new_settings_ptr, bool rebuild_pool)
+{
+    CdiConnectionHandle old_handle = nullptr;
+    {
+        // Stop frames from being sent on the old connection.
+        std::lock_guard<std::mutex> guard(cdi_ptr->connection_mutex);
+        old_handle = cdi_ptr->con_info.connection_handle;
+        cdi_ptr->con_info.connection_handle = nullptr;
+        cdi_ptr->con_info.connection_status = kCdiConnectionStatusDisconnected;
+    }
+
+    // Destroyed without holding connection_mutex, since the SDK can call the connection callback while destroying it.
+    // Once it returns, no payloads of the old connection are in flight.
+    if (old_handle) {
+        CdiCoreConnectionDestroy(old_handle);
+    }
+
+    std::lock_guard<std::mutex> guard(cdi_ptr->connection_mutex);
+
+    cdi_ptr->con_info.test_settings.remote_adapter_ip_str = new_settings_ptr->remote_adapter_ip_str;
+    cdi_ptr->con_info.test_settings.dest_port = new_settings_ptr->dest_port;
+    cdi_ptr->con_info.connection_status = kCdiConnectionStatusDisconnected;
+
+    CdiReturnStatus rs = kCdiStatusOk;
+    if (rebuild_pool) {
+        ApplyVideoFormat(cdi_ptr, new_settings_ptr);
+        DestroyTxPool(cdi_ptr);
+        rs = CreateTxPool(cdi_ptr);
+    }
+    if (kCdiStatusOk == rs) {
+        rs = CreateTxConnection(cdi_ptr);
+    }
+    if (kCdiStatusOk != rs) {
+        blog(LOG_ERROR, "'%s': Failed to recreate CDI connection[%s]. Stopping the output.",
+             cdi_ptr->cdi_name.c_str(), CdiCoreStatusToString(rs));
+        cdi_ptr->con_info.connection_handle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Destroy the CDI connection and release the resources that were acquired for it by cdi_output_start().
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ */
+static void ReleaseConnectionResources(cdi_output* cdi_ptr)
+{
+    //-----------------------------------------------------------------------------------------------------------------
+    // CDI SDK Step 6. Shutdown and clean-up CDI SDK resources.
+    //-----------------------------------------------------------------------------------------------------------------
+    if (cdi_ptr->con_info.connection_handle) {
+        CdiCoreConnectionDestroy(cdi_ptr->con_info.connection_handle);
+        cdi_ptr->con_info.connection_handle = nullptr;
+    }
+    cdi_ptr->con_info.connection_status = kCdiConnectionStatusDisconnected;
+
+    // Give the payload memory back for other connections on the same adapter.
+    DestroyTxPool(cdi_ptr);
+
+    if (cdi_ptr->adapter_handle) {
+        NetworkAdapterDestroy(cdi_ptr->adapter_handle);
+        cdi_ptr->adapter_handle = nullptr;
+    }
+
+    // CdiCoreShutdown() is invoked in obs_module_unload();
+    // Clean-up additional resources used by this application.
+    if (cdi_ptr->con_info.connection_state_change_signal) {
+        CdiOsSignalDelete(cdi_ptr->con_info.connection_state_change_signal);
+        cdi_ptr->con_info.connection_state_change_signal = nullptr;
+    }
+}
+
 /**
  * @brief Called by OBS to get the name of the output from the configuration.
  * 
@@ -377,7 +738,25 @@ obs_properties_t* cdi_output_getproperties(void*)
     obs_properties_t* props = obs_properties_create();
 
     obs_properties_set_flags(props, OBS_PROPERTIES_DEFER_UPDATE);
-    obs_properties_add_text(props, "cdi_name", obs_module_text("CDIPlugin.OutputProps.CDIName"), OBS_TEXT_DEFAULT);
+    obs_properties_add_text(props, OUTPUT_PROP_NAME, obs_module_text("CDIPlugin.OutputProps.CDIName"), OBS_TEXT_DEFAULT);
+    obs_properties_add_text(props, OUTPUT_PROP_DEST_IP, obs_module_text("CDIPlugin.OutputProps.Dest"), OBS_TEXT_DEFAULT);
+    obs_properties_add_int(props, OUTPUT_PROP_DEST_PORT, obs_module_text("CDIPlugin.OutputProps.Port"), 1, 65535, 1);
+    obs_properties_add_text(props, OUTPUT_PROP_LOCAL_IP, obs_module_text("CDIPlugin.OutputProps.LocalIP"), OBS_TEXT_DEFAULT);
+    obs_properties_add_int(props, OUTPUT_PROP_VIDEO_STREAM_ID, obs_module_text("CDIPlugin.OutputProps.VideoStreamId"), 0, 65535, 1);
+    obs_properties_add_int(props, OUTPUT_PROP_AUDIO_STREAM_ID, obs_module_text("CDIPlugin.OutputProps.AudioStreamId"), 0, 65535, 1);
+
+    obs_property_t* sampling = obs_properties_add_list(props, OUTPUT_PROP_VIDEO_SAMPLING,
+        obs_module_text("CDIPlugin.OutputProps.VideoSampling"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(sampling, "YCbCr 4:4:4", kCdiAvmVidYCbCr444);
+    obs_property_list_add_int(sampling, "YCbCr 4:2:2", kCdiAvmVidYCbCr422);
+    obs_property_list_add_int(sampling, "RGB", kCdiAvmVidRGB);
+    obs_properties_add_bool(props, OUTPUT_PROP_ALPHA_USED, obs_module_text("CDIPlugin.OutputProps.AlphaUsed"));
+
+    obs_property_t* bit_depth = obs_properties_add_list(props, OUTPUT_PROP_BIT_DEPTH,
+        obs_module_text("CDIPlugin.OutputProps.BitDepth"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(bit_depth, "8-bit", kCdiAvmVidBitDepth8);
+    obs_property_list_add_int(bit_depth, "10-bit", kCdiAvmVidBitDepth10);
+    obs_property_list_add_int(bit_depth, "12-bit", kCdiAvmVidBitDepth12);
 
     return props;
 }
@@ -389,9 +768,53 @@ obs_properties_t* cdi_output_getproperties(void*)
  */
 void cdi_output_getdefaults(obs_data_t* settings)
 {
-    obs_data_set_default_string(settings, "cdi_name", "obs-cdi output");
+    obs_data_set_default_string(settings, OUTPUT_PROP_NAME, "obs-cdi output");
     obs_data_set_default_bool(settings, "uses_video", true);
     obs_data_set_default_bool(settings, "uses_audio", true);
+    obs_data_set_default_string(settings, OUTPUT_PROP_DEST_IP, "");
+    obs_data_set_default_int(settings, OUTPUT_PROP_DEST_PORT, 5000);
+    obs_data_set_default_string(settings, OUTPUT_PROP_LOCAL_IP, "");
+    obs_data_set_default_int(settings, OUTPUT_PROP_VIDEO_STREAM_ID, 1);
+    obs_data_set_default_int(settings, OUTPUT_PROP_AUDIO_STREAM_ID, 2);
+    obs_data_set_default_int(settings, OUTPUT_PROP_VIDEO_SAMPLING, kCdiAvmVidYCbCr422);
+    obs_data_set_default_bool(settings, OUTPUT_PROP_ALPHA_USED, false);
+    obs_data_set_default_int(settings, OUTPUT_PROP_BIT_DEPTH, kCdiAvmVidBitDepth10);
+}
+
+/**
+ * @brief Waits (bounded by DRAIN_TIMEOUT_MS) for the payloads in flight to complete, then destroys the connection and
+ *        releases its resources. Runs on cdi_output::teardown_thread.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ */
+static void TeardownThread(cdi_output* cdi_ptr)
+{
+    {
+        std::unique_lock<std::mutex> lock(cdi_ptr->drain_mutex);
+        if (!cdi_ptr->drain_cv.wait_for(lock, std::chrono::milliseconds(DRAIN_TIMEOUT_MS),
+                                        [cdi_ptr] { return 0 >= cdi_ptr->payloads_in_flight; })) {
+            blog(LOG_WARNING, "'%s': [%d] payloads still in flight after [%d]ms. Destroying connection anyway.",
+                 cdi_ptr->cdi_name.c_str(), cdi_ptr->payloads_in_flight.load(), DRAIN_TIMEOUT_MS);
+        }
+    }
+
+    // Destroying the connection completes any payloads that are still in flight, so the pool can be released next.
+    std::lock_guard<std::mutex> guard(cdi_ptr->connection_mutex);
+    ReleaseConnectionResources(cdi_ptr);
+    cdi_ptr->payloads_in_flight = 0;
+    cdi_ptr->draining = false;
+}
+
+/**
+ * @brief Waits for the teardown started by cdi_output_stop() to finish.
+ *
+ * @param cdi_ptr Pointer to CDI output data.
+ */
+static void JoinTeardown(cdi_output* cdi_ptr)
+{
+    if (cdi_ptr->teardown_thread.joinable()) {
+        cdi_ptr->teardown_thread.join();
+    }
 }
 
 /**
@@ -405,32 +828,30 @@ bool cdi_output_start(void* data)
 {
     cdi_output* cdi_ptr = (cdi_output*)data;
 
+    // The previous connection must be gone before the new one is created.
+    JoinTeardown(cdi_ptr);
+    cdi_ptr->draining = false;
+
+    // Use the settings from the output's obs_data (see cdi_output_update()) to populate our con_info.
+    {
+        std::lock_guard<std::mutex> guard(cdi_ptr->connection_mutex);
+        cdi_ptr->con_info.test_settings = cdi_ptr->settings;
+        cdi_ptr->cdi_name = cdi_ptr->settings_name;
+    }
+    cdi_ptr->con_info.test_settings.tx_timeout = DEFAULT_TIMEOUT;
+
     uint32_t flags = 0;
     video_t* video = obs_output_video(cdi_ptr->output);
     audio_t* audio = obs_output_audio(cdi_ptr->output);
 
     // Check to make sure there is audio or video.
     if (!video && !audio) {
-        blog(LOG_ERROR, "'%s': no video and audio available", cdi_ptr->cdi_name);
+        blog(LOG_ERROR, "'%s': no video and audio available", cdi_ptr->cdi_name.c_str());
         return false;
     }
 
-    // Get the output settings from the OBS configuration.
-    config_t* obs_config = obs_frontend_get_global_config();
     const video_output_info* video_info = nullptr;
 
-    // Use those settings to populate our con_info.
-    cdi_ptr->con_info.test_settings.local_adapter_ip_str = config_get_string(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_IP);
-    cdi_ptr->con_info.test_settings.dest_port = (int)config_get_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_PORT);
-    cdi_ptr->con_info.test_settings.remote_adapter_ip_str = config_get_string(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_DEST);
-    cdi_ptr->con_info.test_settings.tx_timeout = DEFAULT_TIMEOUT;
-
-    cdi_ptr->con_info.test_settings.video_stream_id = (int)config_get_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_VIDEO_STREAM_ID);
-    cdi_ptr->con_info.test_settings.audio_stream_id = (int)config_get_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_AUDIO_STREAM_ID);
-    cdi_ptr->con_info.test_settings.video_sampling = (CdiAvmVideoSampling)config_get_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_VIDEO_SAMPLING);
-    cdi_ptr->con_info.test_settings.alpha_used = config_get_bool(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_ALPHA_USED);
-    cdi_ptr->con_info.test_settings.bit_depth = (CdiAvmVideoBitDepth)config_get_int(obs_config, SECTION_NAME, PARAM_MAIN_OUTPUT_BIT_DEPTH);
-
     // Get some information about it.
     if (cdi_ptr->uses_video && video) {
         video_info = video_output_get_info(video);
@@ -442,17 +863,8 @@ bool cdi_output_start(void* data)
         uint32_t height = video_output_get_height(video);
 
         blog(LOG_INFO, "Video Format[%d] Width[%d] Height[%d]", format, width, height);
-        if (kCdiAvmVidRGB == cdi_ptr->con_info.test_settings.video_sampling) {
-            if (VIDEO_FORMAT_BGRA != format) {
-                blog(LOG_ERROR, "For RGB output, OSB Studio pixel format must be BGRA. [%d] is not supported.", format);
-                return false;
-            }
-        } else {
-            // 4:2:2 and 4:4:4.
-            if (VIDEO_FORMAT_I444 != format) {
-                blog(LOG_ERROR, "For YCbCr output, OSB Studio pixel format must be I444. [%d] is not supported.", format);
-                return false;
-            }
+        if (!IsVideoFormatSupported(cdi_ptr->con_info.test_settings.video_sampling, format)) {
+            return false;
         }
 
         cdi_ptr->frame_width = width;
@@ -470,74 +882,60 @@ bool cdi_output_start(void* data)
     if (video) {
         MakeVideoConfig(&cdi_ptr->con_info, &cdi_ptr->avm_video_config, &cdi_ptr->video_unit_size, video);
     }
+    SelectVideoConverter(cdi_ptr);
+    cdi_ptr->video_format_pending = false;
     if (audio) {
         MakeAudioConfig(&cdi_ptr->avm_audio_config, &cdi_ptr->audio_unit_size, audio);
     }
 
+    cdi_ptr->con_info.connection_status = kCdiConnectionStatusDisconnected;
     CdiOsSignalCreate(&cdi_ptr->con_info.connection_state_change_signal);
 
     //-----------------------------------------------------------------------------------------------------------------
     // CDI SDK Step 1: Initialize CDI core (must do before initializing adapter or creating connections).
     //-----------------------------------------------------------------------------------------------------------------
     CdiReturnStatus rs = kCdiStatusOk;
-    // See logic in obs_module_load();
+    // Done by the first NetworkAdapterInitialize().
 
     //-----------------------------------------------------------------------------------------------------------------
     // CDI SDK Step 2: Register the EFA adapter.
     //-----------------------------------------------------------------------------------------------------------------
-    CdiAdapterHandle adapter_handle;
     if (kCdiStatusOk == rs) {
-        // Initialize the single instance of the adapter, if needed.
-        void* ret_tx_buffer_ptr;
-        adapter_handle = NetworkAdapterInitialize(cdi_ptr->con_info.test_settings.local_adapter_ip_str, &ret_tx_buffer_ptr);
-        if (nullptr == adapter_handle) {
-            rs = kCdiStatusFatal;
-        } else {
-            uint8_t* tx_buffer_ptr = (uint8_t*)ret_tx_buffer_ptr;
-            if (!CdiPoolCreateAndInitItems("TestTxUserData Pool", MAX_NUMBER_OF_TX_PAYLOADS, 0, 0, sizeof(TestTxUserData),
-                true, // true= Make thread-safe (use OS resource locks)
-                &cdi_ptr->con_info.tx_user_data_pool_handle,
-                InitPoolItem,
-                &tx_buffer_ptr)) {
-                rs = kCdiStatusNotEnoughMemory;
-            }
-        }
+        // Get an adapter of the local IP address with room for the payloads, initializing it if needed.
+        rs = CreateTxPool(cdi_ptr);
     }
 
     //-----------------------------------------------------------------------------------------------------------------
     // CDI SDK Step 3: Create AVM Tx connection.
     //-----------------------------------------------------------------------------------------------------------------
     if (kCdiStatusOk == rs) {
-        CdiTxConfigData config_data = { 0 };
-        config_data.adapter_handle = adapter_handle;
-        config_data.dest_ip_addr_str = cdi_ptr->con_info.test_settings.remote_adapter_ip_str;
-        config_data.dest_port = cdi_ptr->con_info.test_settings.dest_port;
-        config_data.thread_core_num = -1; // -1= Let OS decide which CPU core to use.
-        config_data.connection_log_method_data_ptr = &log_method_data;
-        config_data.connection_cb_ptr = TestConnectionCallback;
-        config_data.connection_user_cb_param = cdi_ptr;
-        config_data.stats_config.disable_cloudwatch_stats = true;
-        
-        blog(LOG_INFO, "Creating AVM Tx connection.");
-        blog(LOG_INFO, "Local IP: [%s]", cdi_ptr->con_info.test_settings.local_adapter_ip_str);
-        blog(LOG_INFO, "Remote: [%s:%d]", config_data.dest_ip_addr_str, config_data.dest_port);
-
-        rs = CdiAvmTxCreate(&config_data, TestAvmTxCallback, &cdi_ptr->con_info.connection_handle);
+        rs = CreateTxConnection(cdi_ptr);
     }
 
     if (kCdiStatusOk == rs) {
         blog(LOG_INFO, "CdiAvmTxCreate() succeeded.");
+    } else {
+        blog(LOG_ERROR, "'%s': Failed to start CDI output[%s].", cdi_ptr->cdi_name.c_str(), CdiCoreStatusToString(rs));
+        ReleaseConnectionResources(cdi_ptr);
+        return false;
     }
 
     //-----------------------------------------------------------------------------------------------------------------
-    // CDI SDK Step 5: Can now send the desired number of payloads. Will send at the specified rate. If we get any
-    // errors or the connection drops, then exit the loop.
+    // CDI SDK Step 5: Can now send the desired number of payloads. Data capture is not begun here, but when the
+    // receiver first connects. See BeginDataCaptureOnConnect().
     //----------------------------------------------------------------------------------------------------------------
+    {
+        std::lock_guard<std::mutex> guard(cdi_ptr->capture_mutex);
+        cdi_ptr->capture_flags = flags;
+        cdi_ptr->capturing = false;
+        cdi_ptr->started = true;
+    }
+    blog(LOG_INFO, "'%s': Waiting for CDI connection before capturing data.", cdi_ptr->cdi_name.c_str());
 
-    //Tell OBS we've started and to start capturing the video and audio frames with the flags we set earlier. 
-    cdi_ptr->started = obs_output_begin_data_capture(cdi_ptr->output, flags);
+    // The connection may have come up before the output was marked as started.
+    BeginDataCaptureOnConnect(cdi_ptr);
 
-    return cdi_ptr->started;
+    return true;
 }
 
 /**
@@ -552,43 +950,41 @@ void cdi_output_stop(void* data, uint64_t ts)
     (void)ts;
     cdi_output* cdi_ptr = (cdi_output*)data;
 
-	std::lock_guard<std::mutex> guard(cdi_ptr->connection_mutex);
-
-    cdi_ptr->started = false;
+    {
+        // Keep the connection callback from beginning data capture while stopping.
+        std::lock_guard<std::mutex> guard(cdi_ptr->capture_mutex);
+        cdi_ptr->started = false;
+        cdi_ptr->capturing = false;
+    }
+    // Called even if capture never began, since OBS uses it to signal that the output has stopped.
     obs_output_end_data_capture(cdi_ptr->output);
 
-    cdi_ptr->frame_width = 0;
-    cdi_ptr->frame_height = 0;
-    
-    cdi_ptr->audio_channels = 0;
-    cdi_ptr->audio_samplerate = 0;
+    // Stop accepting frames, including ones waiting for room in the Tx queue.
+    cdi_ptr->draining = true;
 
-    //-----------------------------------------------------------------------------------------------------------------
-    // CDI SDK Step 6. Shutdown and clean-up CDI SDK resources.
-    //-----------------------------------------------------------------------------------------------------------------
-    if (&cdi_ptr->con_info.connection_handle) {
-        CdiCoreConnectionDestroy(cdi_ptr->con_info.connection_handle);
-        cdi_ptr->con_info.connection_handle = nullptr;
-    }
+    {
+        std::lock_guard<std::mutex> guard(cdi_ptr->connection_mutex);
 
-    NetworkAdapterDestroy();
+        cdi_ptr->frame_width = 0;
+        cdi_ptr->frame_height = 0;
 
-    // CdiCoreShutdown() is invoked in obs_module_unload();
-
-    if (cdi_ptr->con_info.tx_user_data_pool_handle) {
-        CdiPoolPutAll(cdi_ptr->con_info.tx_user_data_pool_handle);
-        CdiPoolDestroy(cdi_ptr->con_info.tx_user_data_pool_handle);
-        cdi_ptr->con_info.tx_user_data_pool_handle = nullptr;
-    }
-    // Clean-up additional resources used by this application.
-    if (cdi_ptr->con_info.connection_state_change_signal) {
-        CdiOsSignalDelete(cdi_ptr->con_info.connection_state_change_signal);
-        cdi_ptr->con_info.connection_state_change_signal = nullptr;
+        cdi_ptr->audio_channels = 0;
+        cdi_ptr->audio_samplerate = 0;
     }
+
+    // Destroying the connection can take a while, so it is done in the background. A new start or destroying the
+    // output waits for it. See JoinTeardown().
+    JoinTeardown(cdi_ptr);
+    cdi_ptr->teardown_thread = std::thread(TeardownThread, cdi_ptr);
 }
 
 /**
- * @brief Called by OBS to update the output with setting changes.
+ * @brief Called by OBS to update the output with setting changes. All connection and format settings come from the
+ *        output's own obs_data, so any number of outputs can be created and driven without the OBS frontend.
+ *
+ *        While the output is started, changes are applied without restarting it: stream identifiers right away, video
+ *        formats at the next video frame and a new destination by recreating only the connection. A new local IP
+ *        address takes effect the next time the output is started.
  * 
  * @param data Pointer to CDI output data structure.
  * @param settings Pointer to OBS settings.
@@ -597,9 +993,78 @@ void cdi_output_update(void* data, obs_data_t* settings)
 {
     cdi_output* cdi_ptr = (cdi_output*)data;
 
-    cdi_ptr->cdi_name = obs_data_get_string(settings, "cdi_name");
+    std::unique_lock<std::mutex> lock(cdi_ptr->connection_mutex);
+
+    cdi_ptr->settings_name = obs_data_get_string(settings, OUTPUT_PROP_NAME);
     cdi_ptr->uses_video = obs_data_get_bool(settings, "uses_video");
     cdi_ptr->uses_audio = obs_data_get_bool(settings, "uses_audio");
+
+    TestSettings* settings_ptr = &cdi_ptr->settings;
+    settings_ptr->local_adapter_ip_str = obs_data_get_string(settings, OUTPUT_PROP_LOCAL_IP);
+    if (settings_ptr->local_adapter_ip_str != cdi_ptr->output_address_str) {
+        // Lets sources that start before the output initialize the adapter with a Tx buffer the output can use.
+        NetworkAdapterRemoveOutputAddress(cdi_ptr->output_address_str.c_str());
+        NetworkAdapterAddOutputAddress(settings_ptr->local_adapter_ip_str.c_str());
+        cdi_ptr->output_address_str = settings_ptr->local_adapter_ip_str;
+    }
+    settings_ptr->remote_adapter_ip_str = obs_data_get_string(settings, OUTPUT_PROP_DEST_IP);
+    settings_ptr->dest_port = (int)obs_data_get_int(settings, OUTPUT_PROP_DEST_PORT);
+    settings_ptr->video_stream_id = (int)obs_data_get_int(settings, OUTPUT_PROP_VIDEO_STREAM_ID);
+    settings_ptr->audio_stream_id = (int)obs_data_get_int(settings, OUTPUT_PROP_AUDIO_STREAM_ID);
+    settings_ptr->video_sampling = (CdiAvmVideoSampling)obs_data_get_int(settings, OUTPUT_PROP_VIDEO_SAMPLING);
+    settings_ptr->alpha_used = obs_data_get_bool(settings, OUTPUT_PROP_ALPHA_USED);
+    settings_ptr->bit_depth = (CdiAvmVideoBitDepth)obs_data_get_int(settings, OUTPUT_PROP_BIT_DEPTH);
+
+    if (!cdi_ptr->started) {
+        return; // Everything is applied by cdi_output_start().
+    }
+
+    TestSettings* current_ptr = &cdi_ptr->con_info.test_settings;
+    current_ptr->video_stream_id = settings_ptr->video_stream_id;
+    current_ptr->audio_stream_id = settings_ptr->audio_stream_id;
+
+    if (settings_ptr->local_adapter_ip_str != current_ptr->local_adapter_ip_str) {
+        blog(LOG_INFO, "'%s': Local IP change takes effect when the output is restarted.", cdi_ptr->cdi_name.c_str());
+    }
+
+    bool recreate_connection = (settings_ptr->remote_adapter_ip_str != current_ptr->remote_adapter_ip_str ||
+                                settings_ptr->dest_port != current_ptr->dest_port);
+    bool rebuild_pool = false;
+
+    const TestSettings* format_ptr = cdi_ptr->video_format_pending ? &cdi_ptr->pending_video_settings : current_ptr;
+    bool format_changed = (settings_ptr->video_sampling != format_ptr->video_sampling ||
+                           settings_ptr->alpha_used != format_ptr->alpha_used ||
+                           settings_ptr->bit_depth != format_ptr->bit_depth);
+    video_t* video = obs_output_video(cdi_ptr->output);
+    if (format_changed && cdi_ptr->frame_width && video) {
+        if (!IsVideoFormatSupported(settings_ptr->video_sampling, video_output_get_format(video))) {
+            blog(LOG_WARNING, "'%s': Keeping the current video format.", cdi_ptr->cdi_name.c_str());
+        } else if (GetTxPayloadSize(cdi_ptr, settings_ptr) > cdi_ptr->tx_payload_size) {
+            // Payload buffers are too small for the new format, so they must be rebuilt with the connection.
+            rebuild_pool = true;
+            recreate_connection = true;
+        } else {
+            // Switched by cdi_output_rawvideo() between two frames.
+            cdi_ptr->pending_video_settings = *settings_ptr;
+            cdi_ptr->video_format_pending = true;
+        }
+    }
+
+    if (recreate_connection) {
+        TestSettings new_settings = *settings_ptr;
+        if (!rebuild_pool) {
+            // Keep the current (or pending) video format.
+            new_settings.video_sampling = format_ptr->video_sampling;
+            new_settings.alpha_used = format_ptr->alpha_used;
+            new_settings.bit_depth = format_ptr->bit_depth;
+        }
+        lock.unlock();
+        if (!RecreateConnection(cdi_ptr, &new_settings, rebuild_pool)) {
+            // Nothing can be sent without a connection, so stop instead of looking started. OBS then calls
+            // cdi_output_stop(), which releases what is left of the connection.
+            obs_output_signal_stop(cdi_ptr->output, OBS_OUTPUT_ERROR);
+        }
+    }
 }
 
 /**
@@ -617,6 +1082,13 @@ void* cdi_output_create(obs_data_t* settings, obs_output_t* output)
 
     cdi_ptr->output = output;
     cdi_ptr->started = false;
+    cdi_ptr->capture_flags = 0;
+    cdi_ptr->capturing = false;
+    cdi_ptr->adapter_handle = nullptr;
+    cdi_ptr->tx_buffer_ptr = nullptr;
+    cdi_ptr->tx_payload_size = 0;
+    cdi_ptr->video_convert_fn = nullptr;
+    cdi_ptr->video_format_pending = false;
 
     cdi_output_update(cdi_ptr, settings);
 
@@ -631,6 +1103,8 @@ void* cdi_output_create(obs_data_t* settings, obs_output_t* output)
 void cdi_output_destroy(void* data)
 {
     cdi_output* cdi_ptr = (cdi_output*)data;
+    JoinTeardown(cdi_ptr);
+    NetworkAdapterRemoveOutputAddress(cdi_ptr->output_address_str.c_str());
     delete cdi_ptr; // Allocated using C++ new.
 }
 
@@ -1158,8 +1632,16 @@ void cdi_output_rawvideo(void* data, struct video_data* frame)
         return; // Not connected, so cannot output the frame.
     }
 
-    if (!cdi_ptr->started || !cdi_ptr->frame_width || !cdi_ptr->frame_height)
+    if (!cdi_ptr->started || cdi_ptr->draining || !cdi_ptr->frame_width || !cdi_ptr->frame_height)
+        return;
+
+    // Format changes from cdi_output_update() are applied on a frame boundary.
+    if (cdi_ptr->video_format_pending) {
+        ApplyVideoFormat(cdi_ptr, &cdi_ptr->pending_video_settings);
+    }
+    if (nullptr == cdi_ptr->video_convert_fn) {
         return;
+    }
 
     TestTxUserData* user_data_ptr = NULL;
     if (!CdiPoolGet(cdi_ptr->con_info.tx_user_data_pool_handle, (void**)&user_data_ptr)) {
@@ -1168,14 +1650,7 @@ void cdi_output_rawvideo(void* data, struct video_data* frame)
     }
     user_data_ptr->cdi_ptr = cdi_ptr;
 
-    bool send_frame = false;
-    if (kCdiAvmVidYCbCr422 == cdi_ptr->con_info.test_settings.video_sampling) {
-        send_frame = ObsToCdi422VideoFrame(user_data_ptr, frame);
-    } else if (kCdiAvmVidYCbCr444 == cdi_ptr->con_info.test_settings.video_sampling) {
-        send_frame = ObsToCdi444VideoFrame(user_data_ptr, frame);
-    } else if (kCdiAvmVidRGB == cdi_ptr->con_info.test_settings.video_sampling) {
-        send_frame = ObsToCdiRgbVideoFrame(user_data_ptr, frame);
-    }
+    bool send_frame = cdi_ptr->video_convert_fn(user_data_ptr, frame);
 
     if (send_frame) {
         CdiPtpTimestamp timestamp;
@@ -1213,7 +1688,7 @@ void cdi_output_rawaudio(void* data, struct audio_data* frame)
         return; // Not connected, so cannot output the frame.
     }
 
-    if (!cdi_ptr->started || !cdi_ptr->audio_samplerate || !cdi_ptr->audio_channels)
+    if (!cdi_ptr->started || cdi_ptr->draining || !cdi_ptr->audio_samplerate || !cdi_ptr->audio_channels)
         return;
 
     TestTxUserData* user_data_ptr = NULL;
@@ -1228,6 +1703,13 @@ void cdi_output_rawaudio(void* data, struct audio_data* frame)
     const int samplebytes = num_samples * CDI_BYTES_PER_AUDIO_SAMPLE; // Each audio sample in CDI uses 3 bytes (24-bit PCM).
     const int data_size = num_channels * samplebytes;
 
+    if (data_size > cdi_ptr->tx_payload_size) {
+        blog(LOG_ERROR, "Audio payload of [%d] bytes does not fit in the [%d] byte payload buffer.", data_size,
+             cdi_ptr->tx_payload_size);
+        CdiPoolPut(cdi_ptr->con_info.tx_user_data_pool_handle, user_data_ptr);
+        return;
+    }
+
     // for each NDI channel, insert 24-bit int audio segment in correct spot of temp buffer.
     for (int current_channel = 0; current_channel < num_channels; current_channel++) {
         // Memory location of where to write 24-bit int for this channel in temp buffer.
@@ -25,12 +25,20 @@
 #include <obs-module.h>
 #include <util/platform.h>
 #include <util/threading.h>
+#include <atomic>
 #include <chrono>
 #include <thread>
+#include <mutex>
 #include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
 #include <QString>
+#include <obs-frontend-api.h>
 
 #include "Config.h"
+#include "cdi-audio.h"
+#include "cdi-unpack.h"
 
 #include <assert.h>
 #include <stdbool.h>
@@ -58,36 +66,83 @@ extern "C" {
 #define PROP_LOCAL_BIND_IP  "local_bind_ip"
 #define PROP_PORT           "listen_port"
 #define PROP_AUDIO          "audio_enable"
-
-// Maximum size is 1920x1080, 4 color planes (RGB has alpha), 16-bit pixel size.
-#define MAX_VIDEO_FRAME_SIZE        (1920*1080*4*2)
-
-// Maximum size of CDI linear receive buffer.
-#define LINEAR_RX_BUFFER_SIZE       (MAX_VIDEO_FRAME_SIZE * 20)
-
-// Maximum size of OBS audio frame (for CDI -> OBS conversion).
-#define MAX_OBS_AUDIO_FRAME_SIZE    (10*10000)
-
-// Get 5 bytes of CDI 10-bit pixel data.
-#define CDI_10_BIT_IN_5_BYTES(IN, A0, B0, C0, A1) \
-        *(A0) = ((uint16_t)*(IN++)) << 2 | *(IN) >> 6; \
-        *(B0) = ((uint16_t)*(IN++) & 0x3F) << 4 | *(IN) >> 4; \
-        *(C0) = ((uint16_t)*(IN++) & 0x0F) << 6 | *(IN) >> 2; \
-        *(A1) = ((uint16_t)*(IN++) & 0x03) << 8 | *(IN++);
-
-// Get 3 bytes of CDI 12-bit pixel data.
-#define CDI_12_BIT_IN_3_BYTES(IN, A0, B0) \
-        *A0 = ((uint16_t)*(IN++) << 4) | (*(IN) >> 4 & 0x0F); \
-        *B0 = ((uint16_t)*(IN++) << 8) | *(IN++);
-
-// If flipping image vertically, so start reading from bottom line, otherwise
-// start at top line.
-// 
-// Note: Not sure why, but with OBS Studio's debug variant must flip the image.
+#define PROP_MEDIA_TYPE     "media_type"
+#define PROP_RX_SGL         "rx_sgl"
+#define PROP_RX_DEPTH       "rx_depth"
+#define PROP_JITTER_MS      "jitter_buffer_ms"
+#define PROP_AUDIO_BLOCK    "audio_block"
+#define PROP_AUDIO_DOWNMIX  "audio_downmix"
+#define PROP_VIDEO_STREAM_ID "video_stream_id"
+#define PROP_AUDIO_STREAM_ID "audio_stream_id"
+#define PROP_VIDEO_SCALE    "video_scale"
+#define PROP_VIDEO_FRAME_INTERVAL "video_frame_interval"
+#define PROP_HIDDEN_AUDIO   "hidden_audio"
+#define PROP_HIDDEN_RELEASE "hidden_release"
+
+// Media type settings: what a source outputs. Payloads of the other type are freed without being converted.
+#define MEDIA_AUDIO_VIDEO           (0)
+#define MEDIA_AUDIO_ONLY            (1)
+#define MEDIA_VIDEO_ONLY            (2)
+
+// Stream identifier setting that shows the first stream received that no other source of the connection has set.
+#define STREAM_ID_AUTO              (-1)
+
+// Number of stream identifiers of each payload type a receiver keeps track of.
+#define MAX_RX_STREAMS              (16)
+
+// Video scales a source can show: full size, and proxies of 1/2 and 1/4 the width and height.
+static const int video_scales[] = { 1, 2, 4 };
+#define VIDEO_SCALE_COUNT           (3)
+
+// Largest number of received video frames per frame shown.
+#define MAX_VIDEO_FRAME_INTERVAL    (60)
+
+// Number of frames the CDI linear receive buffer holds, by default and at most.
+#define DEFAULT_RX_DEPTH_FRAMES     (4)
+#define MAX_RX_DEPTH_FRAMES         (16)
+
+// Frame size the linear receive buffer is sized for until the first video payload is received. Large enough for any
+// 1080p format, the buffer is resized to the actual frame size once known. See CheckRxBufferSize().
+#define INITIAL_RX_FRAME_SIZE       (MAX_PAYLOAD_SIZE)
+
+// Audio block size setting that coalesces audio into blocks of OBS's audio tick, instead of a number of milliseconds.
+#define AUDIO_BLOCK_OBS_TICK        (-1)
+
+// Number of samples per channel of OBS's audio tick.
+#define OBS_AUDIO_TICK_FRAMES       (1024)
+
+// Default audio block size in milliseconds. Turns the common 1 ms audio payloads into a tenth of the OBS calls.
+#define DEFAULT_AUDIO_BLOCK_MS      (10)
+
+// Largest jitter buffer in milliseconds.
+#define MAX_JITTER_BUFFER_MS        (500)
+
+// Number of received payloads that can wait for the worker thread. Must be a power of 2. At least the number of
+// frames the linear receive buffer is sized for plus the video and audio payloads of a full jitter buffer, so the
+// queue itself is never what makes payloads drop.
+#define RX_QUEUE_SIZE               (128)
+
+// When the offset between a payload's PTP timestamp and its arrival time differs from the estimate by more than this,
+// the estimate is reset instead of smoothed. Happens when the sender restarts or its clock steps.
+#define CLOCK_OFFSET_RESET_NS       (1000000000LL)
+
+// Weight of each payload in the smoothed clock offset, as a divisor. Larger values filter out more network jitter, but
+// follow clock drift more slowly.
+#define CLOCK_OFFSET_SMOOTHING      (64)
+
+// Longest the worker thread sleeps at a time while holding a payload, so it still exits promptly.
+#define RX_HOLD_STEP_NS             ((uint64_t)10000000)
+
+// Number of AVM configurations whose conversion plans are kept. Covers a video and an audio stream with a few format
+// changes each.
+#define RX_PLAN_CACHE_SIZE          (8)
+
+// Note: Not sure why, but with OBS Studio's debug variant must flip the image. This is done through the OBS frame's
+// flip flag, so it also applies to payloads handed to OBS without conversion.
 #ifdef DEBUG
-#define GET_OUTPUT_LINE() (height-1 - y)
+#define FLIP_VIDEO (true)
 #else
-#define GET_OUTPUT_LINE() (y)
+#define FLIP_VIDEO (false)
 #endif
 
 /**
@@ -99,6 +154,8 @@ struct TestSettings {
     int dest_port;                     ///< The destination port number.
     CdiConnectionProtocolType protocol_type; ///< Protocol type (AVM or RAW).
     int payload_size;                  ///< Payload size in bytes.
+    bool rx_sgl;                       ///< Receive payloads as SGLs of the SDK packet buffers, without a linear copy.
+    int rx_depth;                      ///< Number of frames the linear receive buffer holds.
 };
 
 /**
@@ -107,6 +164,7 @@ struct TestSettings {
  */
 struct TestConnectionInfo {
     CdiConnectionHandle connection_handle; ///< The connection handle returned by CdiRawTxCreate().
+    CdiAdapterHandle adapter_handle;       ///< The adapter used by the connection, nullptr if not acquired.
 
     TestSettings test_settings;            ///< Test settings data structure provided by the user.
 
@@ -118,12 +176,195 @@ struct TestConnectionInfo {
     volatile CdiConnectionStatus connection_status; ///< Current status of the connection.
 };
 
+/**
+ * @brief A payload received by the CDI receive callback, waiting to be converted and output by the worker thread.
+ */
+struct RxPayload {
+    CdiSgList sgl;              ///< SGL of the payload. Freed with CdiCoreRxFreeBuffer() by the worker thread.
+    bool has_config;            ///< true if config is valid, the sender only includes it when it changes.
+    CdiAvmConfig config;        ///< Copy of the AVM configuration of the payload.
+    int stream_identifier;      ///< AVM stream identifier.
+    uint64_t timestamp;         ///< Presentation time of the payload on the OBS clock (os_gettime_ns()).
+    uint64_t receive_time_ns;   ///< os_gettime_ns() when the payload was queued.
+};
+
+/**
+ * @brief Lock-free queue of received payloads, with a single producer (the CDI receive callback) and a single consumer
+ * (the worker thread).
+ */
+struct RxPayloadQueue {
+    RxPayload entries[RX_QUEUE_SIZE];
+    std::atomic<uint32_t> write_index{0}; ///< Only changed by the producer.
+    std::atomic<uint32_t> read_index{0};  ///< Only changed by the consumer.
+
+    /// @brief Get the entry to fill in, or nullptr if the queue is full. Call EndPush() when filled in.
+    RxPayload* BeginPush()
+    {
+        uint32_t write = write_index.load(std::memory_order_relaxed);
+        if (write - read_index.load(std::memory_order_acquire) >= RX_QUEUE_SIZE) {
+            return nullptr;
+        }
+        return &entries[write & (RX_QUEUE_SIZE - 1)];
+    }
+    /// @brief Make the entry returned by BeginPush() available to the consumer.
+    void EndPush() { write_index.store(write_index.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    /// @brief Get the oldest entry, or nullptr if the queue is empty. Call Pop() when done with it.
+    RxPayload* Front()
+    {
+        uint32_t read = read_index.load(std::memory_order_relaxed);
+        if (read == write_index.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &entries[read & (RX_QUEUE_SIZE - 1)];
+    }
+    /// @brief Get the entry queued position entries after the one returned by Front(), or nullptr if there are not that
+    /// many. Only used by the consumer.
+    const RxPayload* Peek(uint32_t position) const
+    {
+        uint32_t read = read_index.load(std::memory_order_relaxed);
+        if (position >= write_index.load(std::memory_order_acquire) - read) {
+            return nullptr;
+        }
+        return &entries[(read + position) & (RX_QUEUE_SIZE - 1)];
+    }
+    /// @brief Remove the entry returned by Front().
+    void Pop() { read_index.store(read_index.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    /// @brief Number of entries in the queue.
+    uint32_t Depth() const { return write_index.load() - read_index.load(); }
+};
+
+/**
+ * @brief Counters of the receive queue, shown in the source properties.
+ */
+struct RxQueueStats {
+    std::atomic<uint64_t> queued{0};        ///< Payloads queued for the worker thread.
+    std::atomic<uint64_t> dropped{0};       ///< Payloads dropped because the queue was full.
+    std::atomic<uint32_t> max_depth{0};     ///< Highest queue depth seen.
+    std::atomic<uint64_t> latency_sum_ns{0}; ///< Sum of the time from queuing until the payload was freed.
+    std::atomic<uint64_t> latency_max_ns{0}; ///< Highest time from queuing until the payload was freed.
+    std::atomic<uint64_t> processed{0};     ///< Payloads processed by the worker thread.
+    std::atomic<uint64_t> late{0};          ///< Payloads that reached the worker after their presentation time.
+    std::atomic<uint64_t> video_behind{0};  ///< Video frames dropped because the worker thread was behind.
+    std::atomic<int64_t> hold_avg_ns{0};    ///< Smoothed time from arrival until a payload is output.
+};
+
+struct cdi_source;
+
+/// @brief Converts a CDI video payload to an OBS video frame, in a conversion buffer if needed.
+typedef bool (*VideoConvertFn)(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                               CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr);
+
+/// @brief Converts a CDI video payload to an 8-bit OBS video frame at 1/factor of its width and height.
+typedef bool (*VideoProxyFn)(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer, CdiPayloadReader& reader,
+                             const CdiAvmVideoConfig* config_ptr, int factor);
+
+/**
+ * @brief How to convert the payloads of one AVM configuration. Resolved once when the configuration is first received,
+ * so payloads with a known configuration are neither parsed nor inspected again.
+ */
+struct RxConversionPlan {
+    CdiBaselineAvmPayloadType payload_type; ///< Video or audio. Payloads of any other type are ignored.
+    CdiAvmVideoConfig video_config;         ///< Video configuration, if video.
+    VideoConvertFn video_convert_fn;        ///< Converts the video payload, if video.
+    VideoProxyFn video_proxy_fn;            ///< Converts the video payload to a proxy, if video.
+    float color_matrix[16];                 ///< OBS color matrix of the video.
+    float color_range_min[3];               ///< OBS color range minimum of the video.
+    float color_range_max[3];               ///< OBS color range maximum of the video.
+    float proxy_color_matrix[16];           ///< OBS color matrix of the 8-bit proxies of the video.
+    float proxy_color_range_min[3];         ///< OBS color range minimum of the 8-bit proxies of the video.
+    float proxy_color_range_max[3];         ///< OBS color range maximum of the 8-bit proxies of the video.
+    video_trc trc;                          ///< OBS transfer characteristic of the video.
+    CdiAvmAudioChannelGrouping audio_grouping; ///< Audio channel grouping, if audio.
+    int audio_channels;                     ///< Number of audio channels in the payload, if audio.
+    uint32_t samples_per_sec;               ///< Audio sample rate.
+};
+
+/**
+ * @brief Entry of the conversion plan cache, keyed by the stream identifier and the raw AVM configuration.
+ */
+struct RxPlanCacheEntry {
+    bool valid;                 ///< true if the entry is in use.
+    int stream_identifier;      ///< AVM stream identifier.
+    CdiAvmConfig config;        ///< Raw AVM configuration the plan was resolved from.
+    uint64_t last_used;         ///< Lookup count when last used, to evict the least recently used entry.
+    RxConversionPlan plan;      ///< Resolved conversion plan.
+};
+
 /**
  * @brief CDI Source configuration structure.
  */
 struct cdi_source_config {
     QByteArray cdi_source_name; // CDI source name.
-	bool audio_enabled{true}; // Audio enable/disable.
+	std::atomic<bool> audio_enabled{true}; // Audio enable/disable.
+	std::atomic<bool> video_enabled{true}; // Video enable/disable.
+};
+
+/**
+ * @brief A stream received on a connection.
+ */
+struct RxStreamInfo {
+    int stream_identifier;              ///< AVM stream identifier.
+    int frame_size;                     ///< Size in bytes of the last payload of the stream, if video.
+    std::vector<uint8_t> conv_buffer[VIDEO_SCALE_COUNT]; ///< Buffers the video of the stream is converted into, one
+                                                         ///< per scale of video_scales. See SizeBuffer().
+};
+
+/**
+ * @brief A CDI receive connection, shared by all the sources that use the same local IP address, bind IP address and
+ * port. Senders can multiplex several streams on one connection, so payloads are routed to the sources by their AVM
+ * stream identifier. Any number of sources can show a stream, for example to use a feed in several scenes with
+ * different settings. Its video is converted once and output to all of them.
+ */
+struct cdi_receiver {
+    std::string key;                // Key of the receiver in receiver_map.
+    std::string local_ip_str;       // Local adapter IP address. con_info points at this string.
+    std::string bind_ip_str;        // Local IP address to bind to. con_info points at this string.
+    int ref_count = 0;              // Number of sources using the receiver. Uses receiver_mutex.
+
+    TestConnectionInfo con_info{}; // Test connection information.
+    RxPlanCacheEntry rx_plan_cache[RX_PLAN_CACHE_SIZE] = {}; // Conversion plans of the AVM configurations received.
+    uint64_t rx_plan_lookups = 0; // Number of plan cache lookups.
+
+    // Sources the payloads are routed to. The worker thread only uses a source while holding source_mutex, so sources
+    // can be removed at any time.
+    std::mutex source_mutex;                    // Protects the members below and the stream members of the sources.
+    std::vector<cdi_source*> sources;           // Sources using the receiver.
+    std::vector<RxStreamInfo> video_streams;    // Video streams received.
+    std::vector<RxStreamInfo> audio_streams;    // Audio streams received.
+    std::vector<cdi_source*> rx_targets;        // Sources the payload being processed goes to.
+
+    obs_source_frame obs_video_frame;           // OBS video frame structure data. Only used by the worker thread.
+    std::vector<uint8_t> gather_buffer;         // Audio payloads split across SGL entries are gathered here.
+
+    // Conversion and delivery to OBS is done by rx_worker_thread, so the CDI receive thread is only held up for as long
+    // as it takes to queue the payload.
+    RxPayloadQueue rx_queue;                    // Payloads waiting for the worker thread.
+    RxQueueStats rx_stats;                      // Receive queue counters.
+    os_sem_t* rx_sem = nullptr;                 // Posted for each payload queued, or to make the worker exit.
+    std::thread rx_worker_thread;               // Converts and outputs queued payloads.
+    std::atomic<bool> rx_stopping{false};       // When true, the receive callback frees payloads instead of queuing them.
+    std::atomic<bool> rx_worker_exit{false};    // Tells rx_worker_thread to exit.
+    std::atomic<int> rx_callbacks_active{0};    // Number of receive callbacks currently running.
+
+    // The linear receive buffer is sized for rx_depth frames of rx_frame_size bytes. When received frames no longer
+    // fit, rx_resize_thread recreates the connection with a buffer of the right size.
+    int rx_frame_size = INITIAL_RX_FRAME_SIZE;  // Frame size the linear receive buffer is sized for.
+    int rx_received_frame_size = 0;             // Frame size last checked by CheckRxBufferSize(), 0 before the first.
+    std::thread rx_resize_thread;               // Recreates the connection to resize the linear receive buffer.
+    std::mutex rx_resize_mutex;                 // Protects rx_resize_pending and rx_resize_blocked.
+    bool rx_resize_pending = false;             // true while rx_resize_thread is resizing.
+    bool rx_resize_blocked = false;             // Set when the receiver is destroyed, so no resize is started.
+
+    // Origination PTP timestamps are mapped onto the OBS clock with a smoothed offset. Only used by the receive
+    // callback.
+    bool clock_offset_valid = false;            // true once clock_offset_ns has been set.
+    int64_t clock_offset_ns = 0;                // Estimated offset from PTP time to os_gettime_ns() time.
+    std::atomic<uint64_t> rx_jitter_ns{0};      // Largest jitter buffer of the sources, 0 to output right away.
+    int rx_hold_frames = 0;                     // Frames the linear receive buffer holds for the jitter buffer.
+
+    // Memory used, shown in the source properties.
+    std::atomic<uint64_t> rx_buffer_bytes{0};   // Size of the linear receive buffer.
+    std::atomic<uint64_t> conv_buffer_bytes{0}; // Size of the conversion buffers of the streams.
 };
 
 /**
@@ -132,19 +373,68 @@ struct cdi_source_config {
 struct cdi_source {
 	obs_source_t* obs_source; // Pointer to OBS source data.
 	cdi_source_config config; // CDI source configuration data.
+    cdi_receiver* receiver_ptr = nullptr; // Receiver of the source's connection.
+
+    // Connection settings, used when the source is created. Sources that share a receiver get the receive buffer
+    // settings of the source that created it.
+    std::string local_ip_str;               // Local adapter IP address, or a comma separated list of them.
+    std::string bind_ip_str;                // Local IP address to bind to, empty if not used.
+    int port = 0;                           // Port to listen to.
+    bool rx_sgl = false;                    // Receive payloads as SGLs of the SDK packet buffers.
+    int rx_depth = DEFAULT_RX_DEPTH_FRAMES; // Number of frames the linear receive buffer holds.
+
+    // Streams of the connection the source shows. Use the receiver's source_mutex once the source has a receiver.
+    uint64_t jitter_ns = 0;                         // Jitter buffer setting.
+    int video_stream_setting = STREAM_ID_AUTO;      // Video stream identifier setting.
+    int audio_stream_setting = STREAM_ID_AUTO;      // Audio stream identifier setting.
+    int video_stream = STREAM_ID_AUTO;              // Video stream shown, STREAM_ID_AUTO until one is picked.
+    int audio_stream = STREAM_ID_AUTO;              // Audio stream output, STREAM_ID_AUTO until one is picked.
+    int video_scale = 0;                            // Index in video_scales of the size the video is shown at.
+    int video_frame_interval = 1;                   // Show one of every video_frame_interval frames received.
+    uint64_t video_frames = 0;                      // Video frames received of the stream shown.
+
+    // Video is only converted for sources that are shown somewhere: in the program, the preview, a projector or the
+    // multiview. Sources that are not shown still receive, so they resume with the next frame once shown again.
+    std::atomic<bool> shown{false};             // Set by OBS's show and hide callbacks.
+    std::atomic<bool> hidden_audio{true};       // Keep outputting audio while not shown.
+    std::atomic<bool> hidden_release{false};    // Free the conversion buffers of the stream while not shown.
 
-    obs_source_frame obs_video_frame; // OBS video frame structure data.
     obs_source_audio obs_audio_frame; // OBS audio frame structure data.
 
-    uint8_t* conv_buffer; // Buffer used to convert CDI to OBS frame data.
-
-    TestConnectionInfo con_info{}; // Test connection information.
-    CdiAvmVideoConfig video_config{}; // AVM video configuration.
-    CdiAvmAudioConfig audio_config{}; // AVM audio configuration.
-
-    uint8_t obs_audio_buffer[MAX_OBS_AUDIO_FRAME_SIZE];
+    // Buffers are sized from the received stream, see SizeBuffer().
+    std::vector<uint8_t> obs_audio_buffer; // Buffer used to convert CDI to OBS audio data.
+    std::vector<uint8_t> resample_buffer; // Audio after drift compensation.
+
+    // Audio is resampled by a few ppm to follow the OBS clock. Only used by the worker thread.
+    CdiAudioDriftCompensator audio_drift;   // Drift compensation of the audio.
+    int audio_drift_channels = 0;           // Number of channels audio_drift was reset for.
+    uint32_t audio_drift_rate = 0;          // Sample rate audio_drift was reset for.
+    std::atomic<double> audio_drift_ppm{0.0};       // Current drift correction, shown in the source properties.
+    std::atomic<uint64_t> audio_drift_resets{0};    // Audio timeline resets, shown in the source properties.
+
+    // Small audio payloads are coalesced into blocks before they are output, to cut the number of calls into OBS.
+    // Only used by the worker thread, apart from audio_block_setting.
+    std::atomic<int> audio_block_setting{0};    // Block size in milliseconds, 0 for none or AUDIO_BLOCK_OBS_TICK.
+    std::vector<float> audio_block;             // One plane of audio_block_frames samples per channel.
+    int audio_block_frames = 0;                 // Block size in samples per channel, 0 to output audio right away.
+    int audio_block_fill = 0;                   // Samples per channel in audio_block.
+    uint64_t audio_block_timestamp = 0;         // Time on the OBS clock of the first sample in audio_block.
+    std::atomic<uint64_t> audio_outputs{0};     // Number of obs_source_output_audio() calls.
+
+    // Audio groupings with more channels than OBS supports, or than the setting allows, are downmixed. Only used by
+    // the worker thread, apart from audio_downmix_setting.
+    std::atomic<int> audio_downmix_setting{MAX_AV_PLANES}; // Most channels to output: 8, 6 or 2.
+    CdiAudioMix audio_mix = {};                 // Mix of the current grouping, valid if audio_mix_channels is not 0.
+    CdiAvmAudioChannelGrouping audio_mix_grouping = kCdiAvmAudioM; // Grouping audio_mix was resolved for.
+    int audio_mix_channels = 0;                 // Setting audio_mix was resolved for.
+
+    std::atomic<uint64_t> audio_buffer_bytes{0}; // Size of the audio buffers, shown in the source properties.
 };
 
+static std::mutex receiver_mutex;
+/// @brief Receivers in use, keyed by local IP address, bind IP address and port.
+static std::map<std::string, cdi_receiver*> receiver_map;
+
 //*********************************************************************************************************************
 //******************************************* START OF STATIC FUNCTIONS ***********************************************
 //*********************************************************************************************************************
@@ -156,718 +446,1374 @@ struct cdi_source {
  */
 static void TestConnectionCallback(const CdiCoreConnectionCbData* cb_data_ptr)
 {
-    cdi_source* cdi_ptr = (cdi_source*)cb_data_ptr->connection_user_cb_param;
+    cdi_receiver* receiver_ptr = (cdi_receiver*)cb_data_ptr->connection_user_cb_param;
 
     // Update connection state and set state change signal.
-    cdi_ptr->con_info.connection_status = cb_data_ptr->status_code;
-    CdiOsSignalSet(cdi_ptr->con_info.connection_state_change_signal);
+    receiver_ptr->con_info.connection_status = cb_data_ptr->status_code;
+    CdiOsSignalSet(receiver_ptr->con_info.connection_state_change_signal);
+}
+
+/**
+ * @brief Make a buffer hold at least size bytes. The buffer is kept while big enough, so frames of the same format
+ * reuse it, but it is given back when more than twice the size needed, so switching to a smaller format frees memory.
+ *
+ * @param buffer Buffer to size.
+ * @param size Number of bytes needed.
+ *
+ * @return Pointer to the buffer data.
+ */
+static uint8_t* SizeBuffer(std::vector<uint8_t>& buffer, size_t size)
+{
+    if (buffer.size() < size || buffer.size() > size * 2) {
+        // Free the old buffer first, so the old and new buffers are never both allocated.
+        std::vector<uint8_t>().swap(buffer);
+        buffer.resize(size);
+    }
+    return buffer.data();
 }
 
-static void cdi_422_8bit_to_I444(uint8_t* YUV[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr)
+/**
+ * @brief Convert a CDI YCbCr 4:2:2 video frame to OBS.
+ * 
+ * @param frame_ptr Pointer to the OBS video frame to fill in.
+ * @param conv_buffer Buffer to convert the payload into.
+ * @param reader Reader of the CDI payload data.
+ * @param config_ptr Pointer to AVM CDI video configuration structure.
+ *
+ * @return true if successful, other false.
+ */
+static bool Cdi422ToObsVideoFrame(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                                  CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr)
 {
-    uint8_t* Y;
-    uint8_t* U;
-    uint8_t* V;
-    uint8_t* in;
-    int in_linesize = width * 2;
-
-    for (int y = 0; y < height; y++) {
-        Y = YUV[0] + (y * out_linesize[0]);
-        U = YUV[1] + (y * out_linesize[1]);
-        V = YUV[2] + (y * out_linesize[2]);
-        in = payload_ptr + (GET_OUTPUT_LINE() * in_linesize);
-
-        // 4:2:2 8-bit: CB,Y,CR,Y1 (CB = U, CR= V, Y=Y)
-        for (int i = 0; i < width; i += 2) {
-            // Process 2 pixels of 8-bit YUV data.
-            *(U++) = *(in);   // CB
-            *(U++) = *(in++); // Duplicate CB
-            *(Y++) = *(in++); // Y0
-            *(V++) = *(in);   // CR
-            *(V++) = *(in++); // Duplicate CR
-            *(Y++) = *(in++); // Y1
+    bool ret = true;
+
+    // CDI YCbCr 4:2:2 has the same sample order as UYVY (CB,Y0,CR,Y1).
+    frame_ptr->format = VIDEO_FORMAT_UYVY;
+    frame_ptr->linesize[0] = config_ptr->width * 2;
+
+    const uint8_t* linear_ptr = reader.LinearData();
+    if (kCdiAvmVidBitDepth8 == config_ptr->depth && linear_ptr) {
+        if (reader.Size() < (int)(frame_ptr->linesize[0] * config_ptr->height)) {
+            ret = false;
         }
+        // Hand the payload to OBS as is. obs_source_output_video() copies it before returning, and the buffer is
+        // only given back to CDI after that.
+        frame_ptr->data[0] = (uint8_t*)linear_ptr;
+    } else {
+        frame_ptr->data[0] = SizeBuffer(conv_buffer, (size_t)frame_ptr->linesize[0] * config_ptr->height);
+        ret = CdiUnpack422ToUyvy(frame_ptr->data[0], frame_ptr->linesize[0], config_ptr->width, config_ptr->height,
+                                 reader, config_ptr->depth, false);
     }
+
+    return ret;
+}
+
+/**
+ * @brief Convert a CDI YCbCr 4:4:4 video frame to OBS.
+ * 
+ * @param frame_ptr Pointer to the OBS video frame to fill in.
+ * @param conv_buffer Buffer to convert the payload into.
+ * @param reader Reader of the CDI payload data.
+ * @param config_ptr Pointer to AVM CDI video configuration structure.
+ *
+ * @return true if successful, other false.
+ */
+static bool Cdi444ToObsVideoFrame(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                                  CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr)
+{
+    bool ret = true;
+
+    frame_ptr->format = VIDEO_FORMAT_I444; // 4:4:4 8-bit 3 planes.
+
+    // Using 8-bits to hold each pixel.
+    size_t plane_size = (size_t)config_ptr->height * config_ptr->width;
+    frame_ptr->data[0] = SizeBuffer(conv_buffer, plane_size * 3); // Y
+    frame_ptr->data[1] = frame_ptr->data[0] + plane_size; // U
+    frame_ptr->data[2] = frame_ptr->data[1] + plane_size; // V
+
+    frame_ptr->linesize[0] = config_ptr->width; // Y
+    frame_ptr->linesize[1] = config_ptr->width; // U
+    frame_ptr->linesize[2] = config_ptr->width; // V
+
+    ret = CdiUnpack444ToI444(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, reader,
+                             config_ptr->depth, false);
+
+    return ret;
+}
+
+/**
+ * @brief Convert a 10-bit or 12-bit CDI YCbCr 4:2:2 video frame to OBS as P216, keeping the full precision.
+ * 
+ * @param frame_ptr Pointer to the OBS video frame to fill in.
+ * @param conv_buffer Buffer to convert the payload into.
+ * @param reader Reader of the CDI payload data.
+ * @param config_ptr Pointer to AVM CDI video configuration structure.
+ *
+ * @return true if successful, other false.
+ */
+static bool Cdi422ToObsP216Frame(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                                 CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr)
+{
+    frame_ptr->format = VIDEO_FORMAT_P216; // 4:2:2 16-bit, Y plane and interleaved CbCr plane.
+
+    // Both planes have 16-bits for every pixel.
+    frame_ptr->linesize[0] = config_ptr->width * 2; // Y
+    frame_ptr->linesize[1] = config_ptr->width * 2; // CbCr
+    size_t plane_size = (size_t)frame_ptr->linesize[0] * config_ptr->height;
+    frame_ptr->data[0] = SizeBuffer(conv_buffer, plane_size * 2);
+    frame_ptr->data[1] = frame_ptr->data[0] + plane_size;
+
+    return CdiUnpack422ToP216(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, reader,
+                              config_ptr->depth, false);
+}
+
+/**
+ * @brief Convert a 10-bit or 12-bit CDI YCbCr 4:4:4 video frame to OBS as P416, keeping the full precision.
+ * 
+ * @param frame_ptr Pointer to the OBS video frame to fill in.
+ * @param conv_buffer Buffer to convert the payload into.
+ * @param reader Reader of the CDI payload data.
+ * @param config_ptr Pointer to AVM CDI video configuration structure.
+ *
+ * @return true if successful, other false.
+ */
+static bool Cdi444ToObsP416Frame(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                                 CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr)
+{
+    frame_ptr->format = VIDEO_FORMAT_P416; // 4:4:4 16-bit, Y plane and interleaved CbCr plane.
+
+    frame_ptr->linesize[0] = config_ptr->width * 2; // Y
+    frame_ptr->linesize[1] = config_ptr->width * 4; // CbCr
+    size_t y_plane_size = (size_t)frame_ptr->linesize[0] * config_ptr->height;
+    frame_ptr->data[0] = SizeBuffer(conv_buffer, y_plane_size * 3);
+    frame_ptr->data[1] = frame_ptr->data[0] + y_plane_size;
+
+    return CdiUnpack444ToP416(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, reader,
+                              config_ptr->depth, false);
+}
+
+/**
+ * @brief Convert a CDI RGB video frame to OBS.
+ * 
+ * @param frame_ptr Pointer to the OBS video frame to fill in.
+ * @param conv_buffer Buffer to convert the payload into.
+ * @param reader Reader of the CDI payload data.
+ * @param config_ptr Pointer to AVM CDI video configuration structure.
+ *
+ * @return true if successful, other false.
+ */
+static bool CdiRgbToObsVideoFrame(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                                  CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr)
+{
+    bool ret = true;
+    bool alpha_used = (kCdiAvmAlphaUsed == config_ptr->alpha_channel);
+
+    frame_ptr->format = VIDEO_FORMAT_BGRA; // OBS Studio supports this output format, so we will use it here too.
+
+    // Using 8-bits to hold each RGBA pixel.
+    frame_ptr->linesize[0] = config_ptr->width * 4;
+    frame_ptr->data[0] = SizeBuffer(conv_buffer, (size_t)frame_ptr->linesize[0] * config_ptr->height);
+
+    ret = CdiUnpackRgbToBgra(frame_ptr->data[0], frame_ptr->linesize[0], config_ptr->width, config_ptr->height, reader,
+                             config_ptr->depth, alpha_used, false);
+
+    return ret;
+}
+
+/**
+ * @brief Convert a CDI YCbCr 4:2:2 video frame to an OBS UYVY proxy.
+ *
+ * @param frame_ptr Pointer to the OBS video frame to fill in, including its size.
+ * @param conv_buffer Buffer to convert the payload into.
+ * @param reader Reader of the CDI payload data.
+ * @param config_ptr Pointer to AVM CDI video configuration structure.
+ * @param factor Decimation factor, 2 or 4.
+ *
+ * @return true if successful, other false.
+ */
+static bool Cdi422ToObsProxyFrame(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                                  CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr, int factor)
+{
+    frame_ptr->format = VIDEO_FORMAT_UYVY;
+    frame_ptr->width = (config_ptr->width / factor) & ~1;
+    frame_ptr->height = config_ptr->height / factor;
+    frame_ptr->linesize[0] = frame_ptr->width * 2;
+    frame_ptr->data[0] = SizeBuffer(conv_buffer, (size_t)frame_ptr->linesize[0] * frame_ptr->height);
+
+    return CdiUnpack422ToUyvyDecimated(frame_ptr->data[0], frame_ptr->linesize[0], config_ptr->width,
+                                       config_ptr->height, reader, config_ptr->depth, factor);
+}
+
+/**
+ * @brief Convert a CDI YCbCr 4:4:4 video frame to an OBS I444 proxy.
+ *
+ * @param frame_ptr Pointer to the OBS video frame to fill in, including its size.
+ * @param conv_buffer Buffer to convert the payload into.
+ * @param reader Reader of the CDI payload data.
+ * @param config_ptr Pointer to AVM CDI video configuration structure.
+ * @param factor Decimation factor, 2 or 4.
+ *
+ * @return true if successful, other false.
+ */
+static bool Cdi444ToObsProxyFrame(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                                  CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr, int factor)
+{
+    frame_ptr->format = VIDEO_FORMAT_I444;
+    frame_ptr->width = config_ptr->width / factor;
+    frame_ptr->height = config_ptr->height / factor;
+
+    size_t plane_size = (size_t)frame_ptr->width * frame_ptr->height;
+    frame_ptr->data[0] = SizeBuffer(conv_buffer, plane_size * 3); // Y
+    frame_ptr->data[1] = frame_ptr->data[0] + plane_size; // U
+    frame_ptr->data[2] = frame_ptr->data[1] + plane_size; // V
+
+    frame_ptr->linesize[0] = frame_ptr->width; // Y
+    frame_ptr->linesize[1] = frame_ptr->width; // U
+    frame_ptr->linesize[2] = frame_ptr->width; // V
+
+    return CdiUnpack444ToI444Decimated(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height,
+                                       reader, config_ptr->depth, factor);
 }
 
-static void cdi_422_10bit_to_I444(uint8_t* YUV[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr)
+/**
+ * @brief Convert a CDI RGB video frame to an OBS BGRA proxy.
+ *
+ * @param frame_ptr Pointer to the OBS video frame to fill in, including its size.
+ * @param conv_buffer Buffer to convert the payload into.
+ * @param reader Reader of the CDI payload data.
+ * @param config_ptr Pointer to AVM CDI video configuration structure.
+ * @param factor Decimation factor, 2 or 4.
+ *
+ * @return true if successful, other false.
+ */
+static bool CdiRgbToObsProxyFrame(obs_source_frame* frame_ptr, std::vector<uint8_t>& conv_buffer,
+                                  CdiPayloadReader& reader, const CdiAvmVideoConfig* config_ptr, int factor)
 {
-    uint8_t* Y;
-    uint8_t* U;
-    uint8_t* V;
-    uint8_t* in;
-    int in_linesize = width * 2 + (width / 2); // * 2.5
-
-    for (int y = 0; y < height; y++) {
-        Y = YUV[0] + (y * out_linesize[0]);
-        U = YUV[1] + (y * out_linesize[1]);
-        V = YUV[2] + (y * out_linesize[2]);
-        in = payload_ptr + (GET_OUTPUT_LINE() * in_linesize);
-
-        // 4:2:2 10-bit: CB,Y0,CR,Y1 (CB = U, CR= V, Y=Y)
-        for (int x = 0; x < width; x += 2) {
-            // Get 2 pixels of 10-bit YUV data.
-            uint16_t CB, Y0, CR, Y1;
-            CDI_10_BIT_IN_5_BYTES(in, &CB, &Y0, &CR, &Y1);
-
-            // Convert to 8-bit and write out.
-            *(U++) = (uint8_t)(CB >> 2); // CB
-            *(U++) = (uint8_t)(CB >> 2); // Duplicate CB
-            *(Y++) = (uint8_t)(Y0 >> 2);
-            *(V++) = (uint8_t)(CR >> 2);
-            *(V++) = (uint8_t)(CR >> 2); // Duplicate CR
-            *(Y++) = (uint8_t)(Y0 >> 2);
+    bool alpha_used = (kCdiAvmAlphaUsed == config_ptr->alpha_channel);
+
+    frame_ptr->format = VIDEO_FORMAT_BGRA;
+    frame_ptr->width = config_ptr->width / factor;
+    frame_ptr->height = config_ptr->height / factor;
+    frame_ptr->linesize[0] = frame_ptr->width * 4;
+    frame_ptr->data[0] = SizeBuffer(conv_buffer, (size_t)frame_ptr->linesize[0] * frame_ptr->height);
+
+    return CdiUnpackRgbToBgraDecimated(frame_ptr->data[0], frame_ptr->linesize[0], config_ptr->width,
+                                       config_ptr->height, reader, config_ptr->depth, alpha_used, factor);
+}
+
+/**
+ * @brief Convert a CDI video frame once for each scale it is shown at, and output it to every source that shows its
+ * stream and is due a frame.
+ * 
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param stream_ptr Pointer to the stream of the video frame.
+ * @param reader Reader of the CDI payload data.
+ * @param timestamp CDI timestamp of the video frame.
+ * @param plan_ptr Pointer to the conversion plan of the payload's configuration.
+ */
+static void ProcessVideoFrame(cdi_receiver* receiver_ptr, RxStreamInfo* stream_ptr, CdiPayloadReader& reader,
+                              uint64_t timestamp, const RxConversionPlan* plan_ptr)
+{
+    obs_source_frame* frame_ptr = &receiver_ptr->obs_video_frame;
+    std::vector<cdi_source*>& targets = receiver_ptr->rx_targets;
+
+    // Sources that are not shown, and sources that show every Nth frame for the others, skip the frame without
+    // converting it. The conversion buffer of a scale is kept while a source may still need it.
+    size_t due_count = 0;
+    bool keep_buffer[VIDEO_SCALE_COUNT] = {};
+    for (cdi_source* cdi_ptr : targets) {
+        if (!cdi_ptr->shown) {
+            keep_buffer[cdi_ptr->video_scale] |= !cdi_ptr->hidden_release;
+            continue;
+        }
+        keep_buffer[cdi_ptr->video_scale] = true;
+        if (0 == cdi_ptr->video_frames++ % cdi_ptr->video_frame_interval) {
+            targets[due_count++] = cdi_ptr;
+        }
+    }
+    targets.resize(due_count);
+
+    for (int scale = 0; scale < VIDEO_SCALE_COUNT; scale++) {
+        if (!keep_buffer[scale] && !stream_ptr->conv_buffer[scale].empty()) {
+            std::vector<uint8_t>().swap(stream_ptr->conv_buffer[scale]);
+        }
+    }
+
+    frame_ptr->timestamp = timestamp;
+    frame_ptr->flip = FLIP_VIDEO;
+
+    frame_ptr->trc = plan_ptr->trc;
+
+    for (int scale = 0; scale < VIDEO_SCALE_COUNT; scale++) {
+        bool converted = false;
+        for (cdi_source* cdi_ptr : targets) {
+            if (cdi_ptr->video_scale != scale) {
+                continue;
+            }
+            if (!converted) {
+                // Proxies are 8-bit even when the full size frame is 16-bit, so they have their own color parameters.
+                const float* color_matrix = (0 == scale) ? plan_ptr->color_matrix : plan_ptr->proxy_color_matrix;
+                const float* range_min = (0 == scale) ? plan_ptr->color_range_min : plan_ptr->proxy_color_range_min;
+                const float* range_max = (0 == scale) ? plan_ptr->color_range_max : plan_ptr->proxy_color_range_max;
+                memcpy(frame_ptr->color_matrix, color_matrix, sizeof(frame_ptr->color_matrix));
+                memcpy(frame_ptr->color_range_min, range_min, sizeof(frame_ptr->color_range_min));
+                memcpy(frame_ptr->color_range_max, range_max, sizeof(frame_ptr->color_range_max));
+
+                bool ret;
+                if (0 == scale) {
+                    frame_ptr->width = plan_ptr->video_config.width;
+                    frame_ptr->height = plan_ptr->video_config.height;
+                    ret = plan_ptr->video_convert_fn(frame_ptr, stream_ptr->conv_buffer[scale], reader,
+                                                     &plan_ptr->video_config);
+                } else {
+                    ret = plan_ptr->video_proxy_fn(frame_ptr, stream_ptr->conv_buffer[scale], reader,
+                                                   &plan_ptr->video_config, video_scales[scale]);
+                }
+                if (!ret) {
+                    blog(LOG_ERROR, "CDI video payload too small [%d].", reader.Size());
+                    return;
+                }
+                converted = true;
+            }
+            // obs_source_output_video() copies the frame, so every source gets the same one.
+            obs_source_output_video(cdi_ptr->obs_source, frame_ptr);
+        }
+    }
+
+    // Also updated when nothing was converted, so freed buffers show in the properties.
+    uint64_t conv_buffer_bytes = 0;
+    for (const RxStreamInfo& info : receiver_ptr->video_streams) {
+        for (const std::vector<uint8_t>& buffer : info.conv_buffer) {
+            conv_buffer_bytes += buffer.size();
         }
     }
+    receiver_ptr->conv_buffer_bytes = conv_buffer_bytes;
 }
 
-static void cdi_422_12bit_to_I444(uint8_t* YUV[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr)
+/**
+ * @brief Output the coalesced audio block to OBS, however full it is.
+ *
+ * @param cdi_ptr Pointer to CDI source data structure.
+ */
+static void FlushAudioBlock(cdi_source* cdi_ptr)
 {
-    uint8_t* Y;
-    uint8_t* U;
-    uint8_t* V;
-    uint8_t* in;
-    int in_linesize = width * 3;
-
-    for (int y = 0; y < height; y++) {
-        Y = YUV[0] + (y * out_linesize[0]);
-        U = YUV[1] + (y * out_linesize[1]);
-        V = YUV[2] + (y * out_linesize[2]);
-        in = payload_ptr + (GET_OUTPUT_LINE() * in_linesize);
-
-        // 4:2:2 12-bit: CB,Y0,CR,Y1 (C'B = U, C'R= V, Y=Y)
-        for (int x = 0; x < width; x += 2) {
-            // Get 2 pixels of 12-bit YUV data.
-            uint16_t CB, Y0, CR, Y1;
-            CDI_12_BIT_IN_3_BYTES(in, &CB, &Y0);
-            CDI_12_BIT_IN_3_BYTES(in, &CR, &Y1);
-
-            // Convert to 8-bit and write out.
-            *(U++) = (uint8_t)(CB >> 4); // CB
-            *(U++) = (uint8_t)(CB >> 4); // Duplicate CB
-            *(Y++) = (uint8_t)(Y0 >> 4);
-            *(V++) = (uint8_t)(CR >> 4);
-            *(V++) = (uint8_t)(CR >> 4); // Duplicate CR
-            *(Y++) = (uint8_t)(Y0 >> 4);
+    if (0 == cdi_ptr->audio_block_fill) {
+        return;
+    }
+
+    obs_source_audio* frame_ptr = &cdi_ptr->obs_audio_frame;
+    for (int current_channel = 0; current_channel < cdi_ptr->audio_drift_channels; current_channel++) {
+        frame_ptr->data[current_channel] =
+            (uint8_t*)&cdi_ptr->audio_block[(size_t)current_channel * cdi_ptr->audio_block_frames];
+    }
+    frame_ptr->frames = cdi_ptr->audio_block_fill;
+    frame_ptr->timestamp = cdi_ptr->audio_block_timestamp;
+    obs_source_output_audio(cdi_ptr->obs_source, frame_ptr);
+    cdi_ptr->audio_outputs++;
+
+    cdi_ptr->audio_block_fill = 0;
+}
+
+/**
+ * @brief Set the size of the audio blocks from the setting and sample rate, outputting the audio of a block of another
+ * size first.
+ *
+ * @param cdi_ptr Pointer to CDI source data structure.
+ * @param samples_per_sec Sample rate of the audio.
+ */
+static void SizeAudioBlock(cdi_source* cdi_ptr, uint32_t samples_per_sec)
+{
+    int setting = cdi_ptr->audio_block_setting;
+    int block_frames = (AUDIO_BLOCK_OBS_TICK == setting) ? OBS_AUDIO_TICK_FRAMES :
+                                                           (int)((uint64_t)samples_per_sec * setting / 1000);
+    if (block_frames != cdi_ptr->audio_block_frames) {
+        FlushAudioBlock(cdi_ptr);
+        cdi_ptr->audio_block_frames = block_frames;
+    }
+    // Allocated once per format, not per payload.
+    size_t block_size = (size_t)block_frames * cdi_ptr->audio_drift_channels;
+    if (cdi_ptr->audio_block.size() != block_size) {
+        std::vector<float>(block_size).swap(cdi_ptr->audio_block);
+    }
+}
+
+/**
+ * @brief Output drift compensated audio to OBS. Unless coalescing is off, the audio is added to the current block,
+ * which is output each time it is full. The timeline of the audio is continuous, so the timestamp of each block is
+ * exact.
+ *
+ * @param cdi_ptr Pointer to CDI source data structure.
+ * @param planes One plane of audio samples per channel.
+ * @param frames Number of samples per channel.
+ * @param timestamp Time of the first sample on the OBS clock.
+ */
+static void OutputAudio(cdi_source* cdi_ptr, float* const planes[], int frames, uint64_t timestamp)
+{
+    obs_source_audio* frame_ptr = &cdi_ptr->obs_audio_frame;
+    int num_channels = cdi_ptr->audio_drift_channels;
+    uint32_t samples_per_sec = frame_ptr->samples_per_sec;
+
+    SizeAudioBlock(cdi_ptr, samples_per_sec);
+    int block_frames = cdi_ptr->audio_block_frames;
+    if (0 == block_frames) {
+        for (int current_channel = 0; current_channel < num_channels; current_channel++) {
+            frame_ptr->data[current_channel] = (uint8_t*)planes[current_channel];
+        }
+        frame_ptr->frames = frames;
+        frame_ptr->timestamp = timestamp;
+        obs_source_output_audio(cdi_ptr->obs_source, frame_ptr);
+        cdi_ptr->audio_outputs++;
+        return;
+    }
+
+    // After the audio timeline was reset, the audio no longer continues the block, so the block is output as is.
+    if (cdi_ptr->audio_block_fill) {
+        uint64_t block_end = cdi_ptr->audio_block_timestamp +
+                             (uint64_t)cdi_ptr->audio_block_fill * 1000000000 / samples_per_sec;
+        uint64_t half_sample_ns = 500000000 / samples_per_sec;
+        if (timestamp + half_sample_ns < block_end || timestamp > block_end + half_sample_ns) {
+            FlushAudioBlock(cdi_ptr);
+        }
+    }
+
+    int offset = 0;
+    while (offset < frames) {
+        if (0 == cdi_ptr->audio_block_fill) {
+            cdi_ptr->audio_block_timestamp = timestamp + (uint64_t)offset * 1000000000 / samples_per_sec;
+        }
+        int copy_frames = (std::min)(frames - offset, block_frames - cdi_ptr->audio_block_fill);
+        for (int current_channel = 0; current_channel < num_channels; current_channel++) {
+            memcpy(&cdi_ptr->audio_block[(size_t)current_channel * block_frames + cdi_ptr->audio_block_fill],
+                   planes[current_channel] + offset, copy_frames * sizeof(float));
+        }
+        cdi_ptr->audio_block_fill += copy_frames;
+        offset += copy_frames;
+
+        if (cdi_ptr->audio_block_fill == block_frames) {
+            FlushAudioBlock(cdi_ptr);
         }
     }
 }
 
 /**
- * @brief Convert a CDI YCbCr 4:2:2 video frame to OBS.
+ * @brief Convert a CDI audio frame to OBS.
  * 
  * @param cdi_ptr Pointer to CDI source data structure.
  * @param payload_ptr Pointer to CDI payload data.
  * @param payload_size Size of CDI payload in bytes.
  * @param timestamp CDI timestamp of the audio frame.
+ * @param plan_ptr Pointer to the conversion plan of the payload's configuration.
+ */
+static void ProcessAudioFrame(cdi_source* cdi_ptr, void* payload_ptr, int payload_size, uint64_t timestamp,
+                              const RxConversionPlan* plan_ptr)
+{
+	if (!cdi_ptr->config.audio_enabled || (!cdi_ptr->shown && !cdi_ptr->hidden_audio)) {
+        cdi_ptr->audio_block_fill = 0;
+		return;
+	}
+
+    obs_source_audio* frame_ptr = &cdi_ptr->obs_audio_frame;
+
+    // Resolve the mix again when the grouping or the downmix setting changes.
+    int max_channels = cdi_ptr->audio_downmix_setting;
+    if (plan_ptr->audio_grouping != cdi_ptr->audio_mix_grouping || max_channels != cdi_ptr->audio_mix_channels) {
+        if (!CdiAudioResolveMix(plan_ptr->audio_grouping, max_channels, &cdi_ptr->audio_mix)) {
+            return;
+        }
+        cdi_ptr->audio_mix_grouping = plan_ptr->audio_grouping;
+        cdi_ptr->audio_mix_channels = max_channels;
+    }
+    const CdiAudioMix* mix_ptr = &cdi_ptr->audio_mix;
+
+    frame_ptr->samples_per_sec = plan_ptr->samples_per_sec;
+    frame_ptr->speakers = mix_ptr->speakers;
+    int num_channels = mix_ptr->out_channels;
+
+    frame_ptr->timestamp = timestamp;
+	frame_ptr->format = AUDIO_FORMAT_FLOAT_PLANAR;
+
+    // Payloads carry all the channels of their grouping, interleaved.
+    int num_samples_per_channel = payload_size / CDI_BYTES_PER_AUDIO_SAMPLE / mix_ptr->in_channels;
+    frame_ptr->frames = num_samples_per_channel;
+
+    int obs_audio_size = num_channels * num_samples_per_channel * sizeof(float);
+    uint8_t* obs_audio_byte_ptr = SizeBuffer(cdi_ptr->obs_audio_buffer, obs_audio_size);
+    int obs_channel_stride_in_bytes = num_samples_per_channel * sizeof(float);
+    float* channel_planes[MAX_AV_PLANES];
+    for (int current_channel = 0; current_channel < num_channels; current_channel++) {
+        channel_planes[current_channel] = (float*)(obs_audio_byte_ptr + current_channel * obs_channel_stride_in_bytes);
+        frame_ptr->data[current_channel] = (uint8_t*)channel_planes[current_channel];
+    }
+
+    // Convert the 24-bit samples to float and downmix them in one pass.
+    CdiAudioConvert((const uint8_t*)payload_ptr, num_samples_per_channel, mix_ptr, channel_planes);
+
+    // Put the audio on a continuous timeline that follows the OBS clock, so its latency stays constant however long
+    // the source runs. OBS gets the timeline's timestamps instead of the payload's.
+    if (num_channels != cdi_ptr->audio_drift_channels || frame_ptr->samples_per_sec != cdi_ptr->audio_drift_rate) {
+        // Audio of the old format still waiting to be coalesced is dropped.
+        cdi_ptr->audio_block_fill = 0;
+        cdi_ptr->audio_drift.Reset(num_channels, frame_ptr->samples_per_sec);
+        cdi_ptr->audio_drift_channels = num_channels;
+        cdi_ptr->audio_drift_rate = frame_ptr->samples_per_sec;
+    }
+    const float* in_planes[MAX_AV_PLANES];
+    float* out_planes[MAX_AV_PLANES];
+    size_t out_stride_in_bytes = (num_samples_per_channel + 2) * sizeof(float);
+    uint8_t* out_ptr = SizeBuffer(cdi_ptr->resample_buffer, out_stride_in_bytes * num_channels);
+    for (int current_channel = 0; current_channel < num_channels; current_channel++) {
+        in_planes[current_channel] = (const float*)frame_ptr->data[current_channel];
+        out_planes[current_channel] = (float*)(out_ptr + current_channel * out_stride_in_bytes);
+    }
+    uint64_t out_timestamp = 0;
+    int out_frames = cdi_ptr->audio_drift.Process(in_planes, num_samples_per_channel, timestamp, out_planes,
+                                                  &out_timestamp);
+    cdi_ptr->audio_drift_ppm = cdi_ptr->audio_drift.CorrectionPpm();
+    cdi_ptr->audio_drift_resets = cdi_ptr->audio_drift.Resets();
+
+    OutputAudio(cdi_ptr, out_planes, out_frames, out_timestamp);
+    cdi_ptr->audio_buffer_bytes = cdi_ptr->obs_audio_buffer.size() + cdi_ptr->resample_buffer.size() +
+                                  cdi_ptr->audio_block.size() * sizeof(float);
+}
+
+static void ResizeRxThread(cdi_receiver* receiver_ptr);
+
+/**
+ * @brief Get the number of video frames the jitter buffer holds.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
  * @param config_ptr Pointer to AVM CDI video configuration structure.
  *
- * @return true if successful, other false.
+ * @return Number of frames, rounded up.
  */
-static bool Cdi422ToObsVideoFrame(cdi_source* cdi_ptr, uint8_t* payload_ptr, int payload_size, CdiAvmVideoConfig* config_ptr)
+static int JitterBufferFrames(cdi_receiver* receiver_ptr, const CdiAvmVideoConfig* config_ptr)
 {
-    (void)payload_size;
-    bool ret = true;
-    obs_source_frame* frame_ptr = &cdi_ptr->obs_video_frame;
+    uint64_t jitter_ns = receiver_ptr->rx_jitter_ns;
+    if (0 == jitter_ns || 0 == config_ptr->frame_rate_num) {
+        return 0;
+    }
+    uint64_t frame_ns = 1000000000ULL * config_ptr->frame_rate_den / config_ptr->frame_rate_num;
+    return frame_ns ? (int)((jitter_ns + frame_ns - 1) / frame_ns) : 0;
+}
 
-    frame_ptr->format = VIDEO_FORMAT_I444; // 4:4:4 8-bit 3 planes.
+/**
+ * @brief Check that the linear receive buffer fits the received frames and the jitter buffer, and start resizing it if
+ * it does not. Resizing recreates the connection, which drops the frames in flight, so the buffer is only made smaller
+ * when the received format changes to one that needs less than half of it. The first frame sizes the buffer to fit it
+ * exactly, since nothing is shown yet at that point.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param frame_size Size in bytes of one frame of each video stream received.
+ * @param hold_frames Number of frames the jitter buffer holds.
+ */
+static void CheckRxBufferSize(cdi_receiver* receiver_ptr, int frame_size, int hold_frames)
+{
+    if (receiver_ptr->con_info.test_settings.rx_sgl) {
+        return;
+    }
+    int depth = receiver_ptr->con_info.test_settings.rx_depth;
+    uint64_t needed_bytes = (uint64_t)frame_size * (depth + hold_frames);
+    uint64_t buffer_bytes = (uint64_t)receiver_ptr->rx_frame_size * (depth + receiver_ptr->rx_hold_frames);
+    bool shrink = false;
+    if (0 == receiver_ptr->rx_received_frame_size) {
+        shrink = (needed_bytes < buffer_bytes);
+    } else if (frame_size != receiver_ptr->rx_received_frame_size) {
+        shrink = (needed_bytes * 2 < buffer_bytes);
+    }
+    if (needed_bytes <= buffer_bytes && !shrink) {
+        receiver_ptr->rx_received_frame_size = frame_size;
+        return;
+    }
 
-    // Using 8-bits to hold each pixel.
-    frame_ptr->data[0] = cdi_ptr->conv_buffer; // Y
-    frame_ptr->data[1] = frame_ptr->data[0] + (config_ptr->height * config_ptr->width); // U
-    frame_ptr->data[2] = frame_ptr->data[1] + (config_ptr->height * config_ptr->width); // V
+    // While a resize is running, the frame size is not recorded, so the check is made again by the next frame.
+    std::lock_guard<std::mutex> lock(receiver_ptr->rx_resize_mutex);
+    if (receiver_ptr->rx_resize_blocked || receiver_ptr->rx_resize_pending) {
+        return;
+    }
+    receiver_ptr->rx_received_frame_size = frame_size;
+    blog(LOG_INFO, "Resizing receive buffer for [%d] byte frames and [%d] jitter buffer frames (was [%d] and [%d]).",
+         frame_size, hold_frames, receiver_ptr->rx_frame_size, receiver_ptr->rx_hold_frames);
+    receiver_ptr->rx_frame_size = frame_size;
+    receiver_ptr->rx_hold_frames = hold_frames;
+    receiver_ptr->rx_resize_pending = true;
+
+    // A previous resize thread has already cleared rx_resize_pending, so it is done.
+    if (receiver_ptr->rx_resize_thread.joinable()) {
+        receiver_ptr->rx_resize_thread.join();
+    }
+    // Runs on its own thread, since resizing stops this worker thread.
+    receiver_ptr->rx_resize_thread = std::thread(ResizeRxThread, receiver_ptr);
+}
 
-    frame_ptr->linesize[0] = config_ptr->width; // Y
-    frame_ptr->linesize[1] = config_ptr->width; // U
-    frame_ptr->linesize[2] = config_ptr->width; // V
+/**
+ * @brief Resolve the conversion of a video configuration: the conversion function and the OBS color parameters.
+ *
+ * @param plan_ptr Pointer to the plan, with video_config set.
+ */
+static void ResolveVideoPlan(RxConversionPlan* plan_ptr)
+{
+    const CdiAvmVideoConfig* config_ptr = &plan_ptr->video_config;
+
+    // HDR transfer characteristics. Everything else is treated as SDR.
+    plan_ptr->trc = VIDEO_TRC_DEFAULT;
+    if (kCdiAvmVidTcsPQ == config_ptr->tcs || kCdiAvmVidTcsBT2100LINPQ == config_ptr->tcs) {
+        plan_ptr->trc = VIDEO_TRC_PQ;
+    }
+    else if (kCdiAvmVidTcsHLG == config_ptr->tcs || kCdiAvmVidTcsBT2100LINHLG == config_ptr->tcs) {
+        plan_ptr->trc = VIDEO_TRC_HLG;
+    }
 
-    // CDI YCbCr 4:2:2.
-    if (kCdiAvmVidBitDepth8 == config_ptr->depth) {
-        cdi_422_8bit_to_I444(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr);
-    } else if (kCdiAvmVidBitDepth10 == config_ptr->depth) {
-        cdi_422_10bit_to_I444(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr);
-    } else if (kCdiAvmVidBitDepth12 == config_ptr->depth) {
-        cdi_422_12bit_to_I444(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr);
+    video_colorspace colorspace = VIDEO_CS_709;
+    if (kCdiAvmVidColorimetryBT601 == config_ptr->colorimetry) {
+        colorspace = VIDEO_CS_601;
+    }
+    else if (kCdiAvmVidColorimetryBT2020 == config_ptr->colorimetry ||
+             kCdiAvmVidColorimetryBT2100 == config_ptr->colorimetry) {
+        // OBS only has BT.2020 primaries through its BT.2100 color spaces, which differ in the transfer function.
+        colorspace = (VIDEO_TRC_HLG == plan_ptr->trc) ? VIDEO_CS_2100_HLG : VIDEO_CS_2100_PQ;
     }
 
-    return ret;
+    // 10-bit and 12-bit YCbCr is passed on at 16-bit, so HDR and high bit depth canvases get the full precision
+    // without a second conversion. RGB is always narrowed to BGRA, as OBS has no high bit depth RGB frame format.
+    // Proxies are always 8-bit, as they are only meant for monitoring.
+    bool high_bit_depth = (kCdiAvmVidBitDepth8 != config_ptr->depth);
+
+    video_range_type range = VIDEO_RANGE_FULL;
+    if (kCdiAvmVidRangeNarrow == config_ptr->range) {
+        range = VIDEO_RANGE_PARTIAL;
+    }
+
+    video_format high_bit_format = VIDEO_FORMAT_NONE;
+    switch (config_ptr->sampling) {
+        case kCdiAvmVidYCbCr422:
+            plan_ptr->video_convert_fn = high_bit_depth ? Cdi422ToObsP216Frame : Cdi422ToObsVideoFrame;
+            plan_ptr->video_proxy_fn = Cdi422ToObsProxyFrame;
+            high_bit_format = high_bit_depth ? VIDEO_FORMAT_P216 : VIDEO_FORMAT_NONE;
+            break;
+        case kCdiAvmVidYCbCr444:
+            plan_ptr->video_convert_fn = high_bit_depth ? Cdi444ToObsP416Frame : Cdi444ToObsVideoFrame;
+            plan_ptr->video_proxy_fn = Cdi444ToObsProxyFrame;
+            high_bit_format = high_bit_depth ? VIDEO_FORMAT_P416 : VIDEO_FORMAT_NONE;
+            break;
+        case kCdiAvmVidRGB:
+            plan_ptr->video_convert_fn = CdiRgbToObsVideoFrame;
+            plan_ptr->video_proxy_fn = CdiRgbToObsProxyFrame;
+            colorspace = VIDEO_CS_SRGB;
+            plan_ptr->trc = VIDEO_TRC_DEFAULT;
+            break;
+    }
+
+    // The range of 16-bit frames is scaled differently from 8-bit ones, so they need the parameters of their format.
+    video_format_get_parameters(colorspace, range, plan_ptr->proxy_color_matrix, plan_ptr->proxy_color_range_min,
+                                plan_ptr->proxy_color_range_max);
+    if (VIDEO_FORMAT_NONE == high_bit_format) {
+        memcpy(plan_ptr->color_matrix, plan_ptr->proxy_color_matrix, sizeof(plan_ptr->color_matrix));
+        memcpy(plan_ptr->color_range_min, plan_ptr->proxy_color_range_min, sizeof(plan_ptr->color_range_min));
+        memcpy(plan_ptr->color_range_max, plan_ptr->proxy_color_range_max, sizeof(plan_ptr->color_range_max));
+    } else {
+        video_format_get_parameters_for_format(colorspace, range, high_bit_format, plan_ptr->color_matrix,
+                                               plan_ptr->color_range_min, plan_ptr->color_range_max);
+    }
 }
 
-static void cdi_444_8bit_to_I444(uint8_t* YUV[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr)
+/**
+ * @brief Resolve the conversion of an audio configuration: the grouping, number of channels and sample rate. How the
+ * channels are output to OBS depends on the downmix setting, so it is resolved when the audio is processed.
+ *
+ * @param plan_ptr Pointer to the plan.
+ * @param config_ptr Pointer to the audio configuration.
+ */
+static void ResolveAudioPlan(RxConversionPlan* plan_ptr, const CdiAvmAudioConfig* config_ptr)
+{
+    if (config_ptr->sample_rate_khz == kCdiAvmAudioSampleRate48kHz) {
+        plan_ptr->samples_per_sec = 48000;
+    } else if (config_ptr->sample_rate_khz == kCdiAvmAudioSampleRate96kHz) {
+        plan_ptr->samples_per_sec = 96000;
+    }
+
+    plan_ptr->audio_grouping = config_ptr->grouping;
+    plan_ptr->audio_channels = CdiAudioGroupingChannels(config_ptr->grouping);
+}
+
+/**
+ * @brief Parse an AVM configuration and resolve its conversion plan. Configurations that cannot be converted get a
+ * plan with a payload type of kCdiAvmNotBaseline, so their payloads are ignored without parsing them again.
+ *
+ * @param payload Pointer to the received payload, which must have a configuration.
+ * @param plan_ptr Pointer to the plan to fill in.
+ */
+static void ResolveConversionPlan(const RxPayload* payload, RxConversionPlan* plan_ptr)
+{
+    *plan_ptr = {};
+    plan_ptr->payload_type = kCdiAvmNotBaseline;
+
+    // Attempt to convert the generic configuration structure to a baseline profile configuration structure.
+    CdiAvmBaselineConfig baseline_config;
+    CdiReturnStatus rc = CdiAvmParseBaselineConfiguration(&payload->config, &baseline_config);
+    if (kCdiStatusOk != rc) {
+        blog(LOG_ERROR, "Failed to parse baseline configuration [%s].", CdiCoreStatusToString(rc));
+        return;
+    }
+
+    if (kCdiAvmVideo == baseline_config.payload_type) {
+        blog(LOG_INFO, "CDI StreamID[%d] Video Payload Size[%d] AVM Data[%s]", payload->stream_identifier,
+             payload->sgl.total_data_size, payload->config.data);
+        plan_ptr->video_config = baseline_config.video_config;
+        ResolveVideoPlan(plan_ptr);
+        if (plan_ptr->video_convert_fn) {
+            plan_ptr->payload_type = kCdiAvmVideo;
+        }
+    }
+    else if (kCdiAvmAudio == baseline_config.payload_type) {
+        blog(LOG_INFO, "CDI StreamID[%d] Audio Payload Size[%d] AVM Data[%s]", payload->stream_identifier,
+             payload->sgl.total_data_size, payload->config.data);
+        ResolveAudioPlan(plan_ptr, &baseline_config.audio_config);
+        if (plan_ptr->audio_channels) {
+            plan_ptr->payload_type = kCdiAvmAudio;
+        }
+    }
+}
+
+/**
+ * @brief Check whether a plan cache entry was resolved from an AVM configuration.
+ *
+ * @param entry The cache entry, in use.
+ * @param config The AVM configuration.
+ *
+ * @return true if the entry holds the plan of the configuration.
+ */
+static bool IsPlanOfConfig(const RxPlanCacheEntry& entry, const CdiAvmConfig& config)
 {
-    uint8_t* Y;
-    uint8_t* U;
-    uint8_t* V;
-    uint8_t* in;
-    int in_linesize = width * 3;
-
-    for (int y = 0; y < height; y++) {
-        Y = YUV[0] + (y *out_linesize[0]);
-        U = YUV[1] + (y *out_linesize[1]);
-        V = YUV[2] + (y * out_linesize[2]);
-        in = payload_ptr + (GET_OUTPUT_LINE() * in_linesize);
-
-        // 4:4:4 8-bit: CB,Y,CR (CB = U, CR= V, Y=Y)
-        for (int i = 0; i < width; i += 1) {
-            // Process 1 pixel of YUV data.
-            *(U++) = *(in++);
-            *(Y++) = *(in++);
-            *(V++) = *(in++);
+    return entry.config.data_size == config.data_size &&
+           0 == memcmp(entry.config.data, config.data, config.data_size) &&
+           0 == strcmp(entry.config.uri, config.uri);
+}
+
+/**
+ * @brief Get the conversion plan of a received payload from the cache, resolving and caching it on a miss. Payloads
+ * without a configuration use the most recent plan of their stream.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param payload Pointer to the received payload.
+ *
+ * @return Pointer to the plan, or nullptr if the payload has no configuration and none was received for its stream.
+ */
+static const RxConversionPlan* GetConversionPlan(cdi_receiver* receiver_ptr, const RxPayload* payload)
+{
+    uint64_t lookup = ++receiver_ptr->rx_plan_lookups;
+    RxPlanCacheEntry* found_ptr = nullptr;
+    RxPlanCacheEntry* victim_ptr = nullptr;
+
+    for (RxPlanCacheEntry& entry : receiver_ptr->rx_plan_cache) {
+        if (!entry.valid) {
+            victim_ptr = &entry;
+            continue;
+        }
+        if (nullptr == victim_ptr || (victim_ptr->valid && entry.last_used < victim_ptr->last_used)) {
+            victim_ptr = &entry;
+        }
+        if (entry.stream_identifier != payload->stream_identifier) {
+            continue;
+        }
+        if (!payload->has_config) {
+            if (nullptr == found_ptr || entry.last_used > found_ptr->last_used) {
+                found_ptr = &entry;
+            }
+        } else if (IsPlanOfConfig(entry, payload->config)) {
+            found_ptr = &entry;
+            break;
         }
     }
+
+    if (found_ptr) {
+        found_ptr->last_used = lookup;
+        return &found_ptr->plan;
+    }
+    if (!payload->has_config) {
+        return nullptr;
+    }
+
+    victim_ptr->valid = true;
+    victim_ptr->stream_identifier = payload->stream_identifier;
+    victim_ptr->config = payload->config;
+    victim_ptr->last_used = lookup;
+    ResolveConversionPlan(payload, &victim_ptr->plan);
+    return &victim_ptr->plan;
 }
 
-static void cdi_444_10bit_to_I444(uint8_t* YUV[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr)
+/**
+ * @brief Get the payload type of a queued payload from the plan cache, the same way GetConversionPlan() finds its plan
+ * but without resolving a plan or updating the cache.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param payload Pointer to the queued payload.
+ *
+ * @return The payload type, or kCdiAvmNotBaseline if no plan of the payload is cached yet.
+ */
+static CdiBaselineAvmPayloadType GetCachedPayloadType(const cdi_receiver* receiver_ptr, const RxPayload* payload)
 {
-    uint8_t* Y;
-    uint8_t* U;
-    uint8_t* V;
-    uint8_t* in;
-    int in_linesize = width * 3 * 10 / 8;
-
-    for (int y = 0; y < height; y++) {
-        Y = YUV[0] + (y * out_linesize[0]);
-        U = YUV[1] + (y * out_linesize[1]);
-        V = YUV[2] + (y * out_linesize[2]);
-        // Flipping image vertically, so start reading from bottom line.
-        in = payload_ptr + ((height-1 - y) * in_linesize);
-
-        // 4:4:4 10-bit: C0B,Y0,C0R,C1B,Y1,C1R,C2B,Y2,C2R,C3B,Y3,C3R (CB = U, CR= V, Y=Y)
-        for (int x = 0; x < width; x += 4) {
-            // Get 4 pixels of 10-bit YUV data.
-            uint16_t C0B, C1B, C2B, C3B, Y0, Y1, Y2, Y3, C0R, C1R, C2R, C3R;
-            CDI_10_BIT_IN_5_BYTES(in, &C0B, &Y0, &C0R, &C1B);
-            CDI_10_BIT_IN_5_BYTES(in, &Y1, &C1R, &C2B, &Y2);
-            CDI_10_BIT_IN_5_BYTES(in, &C2R, &C3B, &Y3, &C3R);
-
-            // Convert to 8-bit and write out.
-            *(U++) = (uint8_t)(C0B >> 2);
-            *(U++) = (uint8_t)(C1B >> 2);
-            *(U++) = (uint8_t)(C2B >> 2);
-            *(U++) = (uint8_t)(C3B >> 2);
-            *(Y++) = (uint8_t)(Y0 >> 2);
-            *(Y++) = (uint8_t)(Y1 >> 2);
-            *(Y++) = (uint8_t)(Y2 >> 2);
-            *(Y++) = (uint8_t)(Y3 >> 2);
-            *(V++) = (uint8_t)(C0R >> 2);
-            *(V++) = (uint8_t)(C1R >> 2);
-            *(V++) = (uint8_t)(C2R >> 2);
-            *(V++) = (uint8_t)(C3R >> 2);
+    const RxPlanCacheEntry* found_ptr = nullptr;
+    for (const RxPlanCacheEntry& entry : receiver_ptr->rx_plan_cache) {
+        if (!entry.valid || entry.stream_identifier != payload->stream_identifier) {
+            continue;
+        }
+        if (!payload->has_config) {
+            if (nullptr == found_ptr || entry.last_used > found_ptr->last_used) {
+                found_ptr = &entry;
+            }
+        } else if (IsPlanOfConfig(entry, payload->config)) {
+            found_ptr = &entry;
+            break;
         }
     }
+    return found_ptr ? found_ptr->plan.payload_type : kCdiAvmNotBaseline;
 }
 
-static void cdi_444_12bit_to_I444(uint8_t* YUV[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr)
+/**
+ * @brief Check whether a stream identifier is set in the settings of a source of a receiver. Must be called with
+ * source_mutex held.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param video true for a video stream, false for an audio stream.
+ * @param stream_identifier AVM stream identifier.
+ *
+ * @return true if a source has the stream set.
+ */
+static bool IsStreamSet(cdi_receiver* receiver_ptr, bool video, int stream_identifier)
+{
+    for (cdi_source* source_ptr : receiver_ptr->sources) {
+        if ((video ? source_ptr->video_stream_setting : source_ptr->audio_stream_setting) == stream_identifier) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Apply the stream and jitter buffer settings of the sources of a receiver, after a source was added, removed
+ * or updated. Sources with a stream identifier set show that stream. The others keep the stream they picked, unless a
+ * source now has it set, in which case they pick another one. Must be called with source_mutex held.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ */
+static void UpdateReceiverSources(cdi_receiver* receiver_ptr)
+{
+    uint64_t jitter_ns = 0;
+    for (cdi_source* source_ptr : receiver_ptr->sources) {
+        jitter_ns = (std::max)(jitter_ns, source_ptr->jitter_ns);
+        if (STREAM_ID_AUTO != source_ptr->video_stream_setting) {
+            source_ptr->video_stream = source_ptr->video_stream_setting;
+        } else if (IsStreamSet(receiver_ptr, true, source_ptr->video_stream)) {
+            source_ptr->video_stream = STREAM_ID_AUTO;
+        }
+        if (STREAM_ID_AUTO != source_ptr->audio_stream_setting) {
+            source_ptr->audio_stream = source_ptr->audio_stream_setting;
+        } else if (IsStreamSet(receiver_ptr, false, source_ptr->audio_stream)) {
+            source_ptr->audio_stream = STREAM_ID_AUTO;
+        }
+    }
+    // Payloads are held on the shared worker thread, so the receiver uses the largest jitter buffer of its sources.
+    receiver_ptr->rx_jitter_ns = jitter_ns;
+}
+
+/**
+ * @brief Find the sources a received payload is routed to, and keep track of its stream. Sources that pick their
+ * stream automatically all show the same one: the first received that no source has set. Must be called with
+ * source_mutex held.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param payload_type Video or audio.
+ * @param stream_identifier AVM stream identifier of the payload.
+ * @param payload_size Size of the payload in bytes.
+ *
+ * @return Pointer to the stream, with the sources in rx_targets, or nullptr if MAX_RX_STREAMS other streams of the
+ * payload type were received first. Payloads of such streams are ignored.
+ */
+static RxStreamInfo* RouteRxPayload(cdi_receiver* receiver_ptr, CdiBaselineAvmPayloadType payload_type,
+                                    int stream_identifier, int payload_size)
+{
+    bool video = (kCdiAvmVideo == payload_type);
+    receiver_ptr->rx_targets.clear();
+
+    // Keep track of the streams received, so they can be shown in the source properties.
+    std::vector<RxStreamInfo>& streams = video ? receiver_ptr->video_streams : receiver_ptr->audio_streams;
+    auto it = std::find_if(streams.begin(), streams.end(),
+                           [&](const RxStreamInfo& info) { return info.stream_identifier == stream_identifier; });
+    if (it == streams.end()) {
+        if (streams.size() >= MAX_RX_STREAMS) {
+            return nullptr;
+        }
+        blog(LOG_INFO, "Receiving %s stream [%d].", video ? "video" : "audio", stream_identifier);
+        streams.push_back({ stream_identifier, 0, {} });
+        it = streams.end() - 1;
+    }
+    it->frame_size = video ? payload_size : 0;
+
+    // Stream shown by the sources that pick it automatically, if they have picked one.
+    int auto_stream = STREAM_ID_AUTO;
+    for (cdi_source* source_ptr : receiver_ptr->sources) {
+        int setting = video ? source_ptr->video_stream_setting : source_ptr->audio_stream_setting;
+        int stream = video ? source_ptr->video_stream : source_ptr->audio_stream;
+        if (STREAM_ID_AUTO == setting && STREAM_ID_AUTO != stream) {
+            auto_stream = stream;
+        }
+    }
+    bool pick = (STREAM_ID_AUTO == auto_stream || stream_identifier == auto_stream) &&
+                !IsStreamSet(receiver_ptr, video, stream_identifier);
+
+    for (cdi_source* source_ptr : receiver_ptr->sources) {
+        int& stream = video ? source_ptr->video_stream : source_ptr->audio_stream;
+        if (STREAM_ID_AUTO == stream && pick) {
+            blog(LOG_INFO, "Source [%s] shows %s stream [%d].", obs_source_get_name(source_ptr->obs_source),
+                 video ? "video" : "audio", stream_identifier);
+            stream = stream_identifier;
+        }
+        // Sources that do not output the payload's type still pick the stream, so automatic sources stay together,
+        // but the payload is not converted for them.
+        bool enabled = video ? source_ptr->config.video_enabled : source_ptr->config.audio_enabled;
+        if (stream == stream_identifier && enabled) {
+            receiver_ptr->rx_targets.push_back(source_ptr);
+        }
+    }
+    return &*it;
+}
+
+/**
+ * @brief Get the size of one frame of each video stream received, which the linear receive buffer must hold for each
+ * frame of its depth. Must be called with source_mutex held.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ *
+ * @return Size in bytes.
+ */
+static int RxFrameBytes(cdi_receiver* receiver_ptr)
+{
+    int frame_size = 0;
+    for (const RxStreamInfo& info : receiver_ptr->video_streams) {
+        frame_size += info.frame_size;
+    }
+    return frame_size;
+}
+
+/**
+ * Get the time a payload is released to be output: its presentation time with the jitter buffer enabled, right
+ * away otherwise.
+ *
+ * @param jitter_ns Jitter buffer in nanoseconds, 0 if disabled.
+ * @param payload Pointer to the received payload.
+ *
+ * @return Release time on the OBS clock.
+ */
+static uint64_t RxReleaseTime(uint64_t jitter_ns, const RxPayload* payload)
+{
+    if (0 == jitter_ns) {
+        return payload->receive_time_ns;
+    }
+    // Never hold a payload for more than twice the jitter buffer, in case the clock offset estimate is off.
+    return (std::min)(payload->timestamp, payload->receive_time_ns + jitter_ns * 2);
+}
+
+/**
+ * Check if the worker thread is behind real time on a video stream: a later frame of the stream is already
+ * queued and due to be output. Frames waiting in the jitter buffer are not due yet, so they do not count. A sender can
+ * give audio the same stream identifier as video, so only later payloads known to be video count.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param payload Pointer to the video payload at the front of the queue.
+ *
+ * @return true if the payload should be dropped in favor of the later frame.
+ */
+static bool IsRxVideoBehind(cdi_receiver* receiver_ptr, const RxPayload* payload)
 {
-    uint8_t* Y;
-    uint8_t* U;
-    uint8_t* V;
-    uint8_t* in;
-    int in_linesize = width * 3 * 12 / 8;
-
-    for (int y = 0; y < height; y++) {
-        Y = YUV[0] + (y * out_linesize[0]);
-        U = YUV[1] + (y * out_linesize[1]);
-        V = YUV[2] + (y * out_linesize[2]);
-        in = payload_ptr + (GET_OUTPUT_LINE() * in_linesize);
-
-        // 4:4:4 12-bit: C0B,Y0,C0R,C1B,Y1,C1R (CB = U, CR= V, Y=Y)
-        for (int x = 0; x < width; x += 2) {
-            // Get 2 pixels of 12s-bit YUV data.
-            uint16_t C0B, C1B, Y0, Y1, C0R, C1R;
-            CDI_12_BIT_IN_3_BYTES(in, &C0B, &Y0);
-            CDI_12_BIT_IN_3_BYTES(in, &C0R, &C1B);
-            CDI_12_BIT_IN_3_BYTES(in, &Y1, &C1R);
-
-            // Convert to 8-bit and write out.
-            *(U++) = (uint8_t)(C0B >> 4);
-            *(U++) = (uint8_t)(C1B >> 4);
-            *(Y++) = (uint8_t)(Y0 >> 4);
-            *(Y++) = (uint8_t)(Y1 >> 4);
-            *(V++) = (uint8_t)(C0R >> 4);
-            *(V++) = (uint8_t)(C1R >> 4);
+    uint64_t jitter_ns = receiver_ptr->rx_jitter_ns;
+    uint64_t now_ns = os_gettime_ns();
+    const RxPayload* next_ptr = nullptr;
+    for (uint32_t position = 1; nullptr != (next_ptr = receiver_ptr->rx_queue.Peek(position)); position++) {
+        if (next_ptr->stream_identifier == payload->stream_identifier && RxReleaseTime(jitter_ns, next_ptr) <= now_ns &&
+            kCdiAvmVideo == GetCachedPayloadType(receiver_ptr, next_ptr)) {
+            return true;
         }
     }
+    return false;
 }
 
 /**
- * @brief Convert a CDI YCbCr 4:4:4 video frame to OBS.
- * 
- * @param cdi_ptr Pointer to CDI source data structure.
- * @param payload_ptr Pointer to CDI payload data.
- * @param payload_size Size of CDI payload in bytes.
- * @param timestamp CDI timestamp of the audio frame.
- * @param config_ptr Pointer to AVM CDI video configuration structure.
+ * Convert a received payload and output it to the sources that show its stream. Runs on the worker thread.
  *
- * @return true if successful, other false.
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param payload Pointer to the received payload.
  */
-static bool Cdi444ToObsVideoFrame(cdi_source* cdi_ptr, uint8_t* payload_ptr, int payload_size, CdiAvmVideoConfig* config_ptr)
+static void ProcessRxPayload(cdi_receiver* receiver_ptr, RxPayload* payload)
 {
-    (void)payload_size;
-    bool ret = true;
-    obs_source_frame* frame_ptr = &cdi_ptr->obs_video_frame;
-
-    frame_ptr->format = VIDEO_FORMAT_I444; // 4:4:4 8-bit 3 planes.
+    const RxConversionPlan* plan_ptr = GetConversionPlan(receiver_ptr, payload);
+    if (nullptr == plan_ptr || kCdiAvmNotBaseline == plan_ptr->payload_type) {
+        return;
+    }
 
-    // Using 16-bits to hold each pixel.
-    frame_ptr->data[0] = cdi_ptr->conv_buffer; // Y
-    frame_ptr->data[1] = frame_ptr->data[0] + (config_ptr->height * config_ptr->width*2); // U
-    frame_ptr->data[2] = frame_ptr->data[1] + (config_ptr->height * config_ptr->width*2); // V
+    // When OBS or the CPU cannot keep up, converting every frame only makes the worker fall further behind until the
+    // queue overflows and audio is lost too. Video frames that a later frame has caught up with are dropped before they
+    // are converted, so the newest frame is always shown. Audio is never dropped here.
+    if (kCdiAvmVideo == plan_ptr->payload_type && IsRxVideoBehind(receiver_ptr, payload)) {
+        receiver_ptr->rx_stats.video_behind++;
+        return;
+    }
 
-    frame_ptr->linesize[0] = config_ptr->width; // Y
-    frame_ptr->linesize[1] = config_ptr->width; // U
-    frame_ptr->linesize[2] = config_ptr->width; // V
+    uint64_t timestamp = payload->timestamp;
+    // In SGL receive mode payloads arrive as the SDK's packet buffers, which the reader walks directly.
+    CdiPayloadReader reader(&payload->sgl);
+    int payload_size = reader.Size();
 
-    if (kCdiAvmVidBitDepth8 == config_ptr->depth) {
-        cdi_444_8bit_to_I444(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr);
-    } else if (kCdiAvmVidBitDepth10 == config_ptr->depth) {
-        cdi_444_10bit_to_I444(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr);
-    } else if (kCdiAvmVidBitDepth12 == config_ptr->depth) {
-        cdi_444_12bit_to_I444(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr);
+    std::lock_guard<std::mutex> lock(receiver_ptr->source_mutex);
+    RxStreamInfo* stream_ptr = RouteRxPayload(receiver_ptr, plan_ptr->payload_type, payload->stream_identifier,
+                                              payload_size);
+    if (nullptr == stream_ptr) {
+        return;
     }
 
-    return ret;
-}
-
-static void cdi_rgb_to_rgba_8bit(uint8_t* BGRA[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr, bool alpha_used)
-{
-    uint8_t* out;
-    uint8_t* in;
-    int in_linesize = width * 3;
-
-    for (int y = 0; y < height; y++) {
-        out = BGRA[0] + (y * out_linesize[0]);
-        in = payload_ptr + (GET_OUTPUT_LINE() * in_linesize);
-
-        // RGB 8-bit: R, G, B
-        for (int x = 0; x < width; x += 1) {
-            // Process 1 pixel of RGB data.
-            *(out++) = *(in++); // R
-            *(out++) = *(in++); // G
-            *(out++) = *(in++); // B
-            *(out++) = 0xFF; // Write 0xff for alpha
+    if (kCdiAvmVideo == plan_ptr->payload_type) {
+        // The linear receive buffer holds the frames of every video stream, whether a source shows them or not.
+        CheckRxBufferSize(receiver_ptr, RxFrameBytes(receiver_ptr),
+                          JitterBufferFrames(receiver_ptr, &plan_ptr->video_config));
+        if (!receiver_ptr->rx_targets.empty()) {
+            ProcessVideoFrame(receiver_ptr, stream_ptr, reader, timestamp, plan_ptr);
         }
     }
-
-    if (alpha_used) {
-        int in_offset = height * in_linesize;
-        int a_in_linesize = width; // Linesize for CDI alpha.
-        uint8_t* A;
-            for (int y = 0; y < height; y++) {
-            A = BGRA[0] + (y * out_linesize[0] + 3); // BGRA format, so A is + 3.
-            in = payload_ptr + in_offset + (GET_OUTPUT_LINE() * a_in_linesize);
-
-            // Since CDI alpha only uses one plane, we process 1 alpha values at a time.
-            for (int x = 0; x < width; x += 1) {
-                *(A) = *(in++); // A
-                A += 4; // Alpha is every 4 bytes.
-            }
+    else if (kCdiAvmAudio == plan_ptr->payload_type && !receiver_ptr->rx_targets.empty()) {
+        // Audio payloads are small, so ones split across SGL entries are simply gathered.
+        const uint8_t* payload_ptr = reader.LinearData();
+        if (nullptr == payload_ptr) {
+            payload_ptr = reader.Read(0, payload_size, SizeBuffer(receiver_ptr->gather_buffer, payload_size));
+        }
+        // Each source has its own audio settings and timeline, so the audio is converted for each of them.
+        for (cdi_source* cdi_ptr : receiver_ptr->rx_targets) {
+            ProcessAudioFrame(cdi_ptr, (void*)payload_ptr, payload_size, timestamp, plan_ptr);
         }
     }
 }
 
-static void cdi_rgb_to_rgba_10bit(uint8_t* BGRA[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr, bool alpha_used)
+/**
+ * Free the buffer of a received payload, giving it back to the CDI SDK.
+ *
+ * @param sgl_ptr Pointer to the SGL of the payload.
+ */
+static void FreeRxBuffer(const CdiSgList* sgl_ptr)
 {
-    uint8_t* out;
-    uint8_t* in;
-    int in_linesize = width * 3 * 10 / 8;
-
-    for (int y = 0; y < height; y++) {
-        out = BGRA[0] + (y * out_linesize[0]);
-        in = payload_ptr + (GET_OUTPUT_LINE() * in_linesize);
-
-        // RGB 10-bit: R0, G0, B0, R1, G1, B1, R2, G2, B2, R3, G3, B3
-        for (int x = 0; x < width; x += 4) {
-            // Get 4 pixels of 10-bit RGB data.
-            uint16_t B0, G0, R0, B1, G1, R1, B2, G2, R2, B3, G3, R3;
-            CDI_10_BIT_IN_5_BYTES(in, &R0, &G0, &B0, &R1);
-            CDI_10_BIT_IN_5_BYTES(in, &G1, &B1, &R2, &G2);
-            CDI_10_BIT_IN_5_BYTES(in, &B2, &R3, &G3, &B3);
-
-            // Convert to 8-bit and write out in BGRA order.
-            *(out++) = (uint8_t)(B0 >> 2);
-            *(out++) = (uint8_t)(G0 >> 2);
-            *(out++) = (uint8_t)(R0 >> 2);
-            *(out++) = 0xFF; // Write 0xff for alpha
-            *(out++) = (uint8_t)(B1 >> 2);
-            *(out++) = (uint8_t)(G1 >> 2);
-            *(out++) = (uint8_t)(R1 >> 2);
-            *(out++) = 0xFF; // Write 0xff for alpha
-            *(out++) = (uint8_t)(B2 >> 2);
-            *(out++) = (uint8_t)(G2 >> 2);
-            *(out++) = (uint8_t)(R2 >> 2);
-            *(out++) = 0xFF; // Write 0xff for alpha
-            *(out++) = (uint8_t)(B3 >> 2);
-            *(out++) = (uint8_t)(G3 >> 2);
-            *(out++) = (uint8_t)(R3 >> 2);
-            *(out++) = 0xFF; // Write 0xff for alpha
-        }
+    CdiReturnStatus rs = CdiCoreRxFreeBuffer(sgl_ptr);
+    if (kCdiStatusOk != rs) {
+        blog(LOG_ERROR, "CdiCoreRxFreeBuffer failed[%s].", CdiCoreStatusToString(rs));
     }
+}
+
+/**
+ * Hold a payload until its presentation time when the jitter buffer is enabled.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param payload Pointer to the received payload.
+ *
+ * @return true if the payload should be output, false if the worker was told to exit while holding it.
+ */
+static bool HoldRxPayload(cdi_receiver* receiver_ptr, const RxPayload* payload)
+{
+    RxQueueStats* stats_ptr = &receiver_ptr->rx_stats;
+    uint64_t jitter_ns = receiver_ptr->rx_jitter_ns;
+    uint64_t now_ns = os_gettime_ns();
 
-    if (alpha_used) {
-        int in_offset = height * in_linesize;
-        int a_in_linesize = width * 10 / 8; // Linesize for CDI alpha.
-        uint8_t* A;
-        for (int y = 0; y < height; y++) {
-            A = BGRA[0] + (y * out_linesize[0] + 3); // BGRA format, so A is + 3.
-            in = payload_ptr + in_offset + (GET_OUTPUT_LINE() * a_in_linesize);
-
-            // Since CDI alpha only uses one plane, we can process 4 alpha values at a time.
-            for (int x = 0; x < width; x += 4) {
-                uint16_t A0, A1, A2, A3;
-                CDI_10_BIT_IN_5_BYTES(in, &A0, &A1, &A2, &A3);
-                *(A) = (uint8_t)(A0 >> 2); // A
-                A += 4; // Alpha is every 4 bytes.
-                *(A) = (uint8_t)(A1 >> 2);
-                A += 4;
-                *(A) = (uint8_t)(A2 >> 2);
-                A += 4;
-                *(A) = (uint8_t)(A3 >> 2);
-                A += 4;
+    if (jitter_ns) {
+        if (now_ns > payload->timestamp) {
+            stats_ptr->late++;
+        }
+        uint64_t release_ns = RxReleaseTime(jitter_ns, payload);
+        while (now_ns < release_ns) {
+            if (receiver_ptr->rx_worker_exit) {
+                return false;
             }
+            os_sleepto_ns((std::min)(release_ns, now_ns + RX_HOLD_STEP_NS));
+            now_ns = os_gettime_ns();
         }
     }
+
+    int64_t hold_ns = (int64_t)(now_ns - payload->receive_time_ns);
+    int64_t hold_avg_ns = stats_ptr->hold_avg_ns;
+    stats_ptr->hold_avg_ns = hold_avg_ns + (hold_ns - hold_avg_ns) / 16;
+    return true;
 }
 
-static void cdi_rgb_to_rgba_12bit(uint8_t* BGRA[], uint32_t out_linesize[], int width, int height, uint8_t* payload_ptr, bool alpha_used)
+/**
+ * Worker thread that converts the queued payloads, outputs them to OBS and frees their buffers.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ */
+static void RxWorkerThread(cdi_receiver* receiver_ptr)
 {
-    uint8_t* out;
-    uint8_t* in;
-    int in_linesize = width * 3 * 12 / 8;
-
-    for (int y = 0; y < height; y++) {
-        out = BGRA[0] + (y * out_linesize[0]);
-        in = payload_ptr + (GET_OUTPUT_LINE() * in_linesize);
-
-        // RGB 12-bit: R0, G0, B0, R1, G1, B1
-        for (int x = 0; x < width; x += 2) {
-            // Get 2 pixels of 12-bit RGB data.
-            uint16_t B0, G0, R0, B1, G1, R1;
-            CDI_12_BIT_IN_3_BYTES(in, &R0, &G0);
-            CDI_12_BIT_IN_3_BYTES(in, &B0, &R1);
-            CDI_12_BIT_IN_3_BYTES(in, &G1, &B1);
-
-            // Convert to 8-bit and write out in BGRA order.
-            *(out++) = (uint8_t)(B0 >> 4);
-            *(out++) = (uint8_t)(G0 >> 4);
-            *(out++) = (uint8_t)(R0 >> 4);
-            *(out++) = 0xFF; // Write 0xff for alpha
-            *(out++) = (uint8_t)(B1 >> 4);
-            *(out++) = (uint8_t)(G1 >> 4);
-            *(out++) = (uint8_t)(R1 >> 4);
-            *(out++) = 0xFF; // Write 0xff for alpha
-        }
-    }
+    bool exiting = false;
+    while (!exiting) {
+        os_sem_wait(receiver_ptr->rx_sem);
+        exiting = receiver_ptr->rx_worker_exit;
+
+        RxPayload* payload = nullptr;
+        while (nullptr != (payload = receiver_ptr->rx_queue.Front())) {
+            if (!exiting) {
+                exiting = !HoldRxPayload(receiver_ptr, payload);
+            }
+            if (!exiting) {
+                ProcessRxPayload(receiver_ptr, payload);
+            }
+            FreeRxBuffer(&payload->sgl);
+
+            uint64_t latency_ns = os_gettime_ns() - payload->receive_time_ns;
+            receiver_ptr->rx_queue.Pop();
 
-    if (alpha_used) {
-        int in_offset = height * in_linesize;
-        int a_in_linesize = width * 12 / 8; // Linesize for CDI alpha.
-        uint8_t* A;
-        for (int y = 0; y < height; y++) {
-            A = BGRA[0] + (y * out_linesize[0] + 3); // BGRA format, so A is + 3.
-            in = payload_ptr + in_offset + (GET_OUTPUT_LINE() * a_in_linesize);
-
-            // Since CDI alpha only uses one plane, we can process 2 alpha values at a time.
-            for (int x = 0; x < width; x += 2) {
-                uint16_t A0, A1;
-                CDI_12_BIT_IN_3_BYTES(in, &A0, &A1);
-                *(A) = (uint8_t)(A0 >> 4); // A
-                A += 4; // Alpha is every 4 bytes.
-                *(A) = (uint8_t)(A1 >> 4);
-                A += 4;
+            RxQueueStats* stats_ptr = &receiver_ptr->rx_stats;
+            stats_ptr->processed++;
+            stats_ptr->latency_sum_ns += latency_ns;
+            if (latency_ns > stats_ptr->latency_max_ns) {
+                stats_ptr->latency_max_ns = latency_ns;
             }
         }
     }
 }
 
 /**
- * @brief Convert a CDI RGB video frame to OBS.
- * 
- * @param cdi_ptr Pointer to CDI source data structure.
- * @param payload_ptr Pointer to CDI payload data.
- * @param payload_size Size of CDI payload in bytes.
- * @param timestamp CDI timestamp of the audio frame.
- * @param config_ptr Pointer to AVM CDI video configuration structure.
+ * Map the origination PTP timestamp of a payload onto the OBS clock. The offset between the two clocks is estimated
+ * from the arrival times of the payloads and smoothed, so network jitter does not end up in the timestamps while clock
+ * drift is still followed. Audio and video share the estimate, so they stay in sync. Only called by the receive
+ * callback.
  *
- * @return true if successful, other false.
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ * @param ptp_ptr Pointer to the origination PTP timestamp of the payload.
+ * @param receive_time_ns os_gettime_ns() when the payload was received.
+ *
+ * @return Presentation time of the payload on the OBS clock, including the jitter buffer.
  */
-static bool CdiRgbToObsVideoFrame(cdi_source* cdi_ptr, uint8_t* payload_ptr, int payload_size, CdiAvmVideoConfig* config_ptr)
+static uint64_t MapPtpToObsTime(cdi_receiver* receiver_ptr, const CdiPtpTimestamp* ptp_ptr, uint64_t receive_time_ns)
 {
-    (void)payload_size;
-    bool ret = true;
-    bool alpha_used = (kCdiAvmAlphaUsed == config_ptr->alpha_channel);
+    uint64_t jitter_ns = receiver_ptr->rx_jitter_ns;
 
-    obs_source_frame* frame_ptr = &cdi_ptr->obs_video_frame;
-    frame_ptr->format = VIDEO_FORMAT_BGRA; // OBS Studio supports this output format, so we will use it here too.
+    // Senders that do not set the timestamp are presented relative to their arrival.
+    if (0 == ptp_ptr->seconds && 0 == ptp_ptr->nanoseconds) {
+        return receive_time_ns + jitter_ns;
+    }
 
-    // Using 8-bits to hold each RGBA pixel.
-    frame_ptr->data[0] = cdi_ptr->conv_buffer;
-    frame_ptr->linesize[0] = config_ptr->width * 4;
+    uint64_t ptp_ns = (uint64_t)ptp_ptr->seconds * 1000000000ULL + ptp_ptr->nanoseconds;
+    int64_t offset_ns = (int64_t)(receive_time_ns - ptp_ns);
+    int64_t error_ns = offset_ns - receiver_ptr->clock_offset_ns;
 
-    if (kCdiAvmVidBitDepth8 == config_ptr->depth) {
-        cdi_rgb_to_rgba_8bit(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr, alpha_used);
-    } else if (kCdiAvmVidBitDepth10 == config_ptr->depth) {
-        cdi_rgb_to_rgba_10bit(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr, alpha_used);
-    } else if (kCdiAvmVidBitDepth12 == config_ptr->depth) {
-        cdi_rgb_to_rgba_12bit(frame_ptr->data, frame_ptr->linesize, config_ptr->width, config_ptr->height, payload_ptr, alpha_used);
+    if (!receiver_ptr->clock_offset_valid || error_ns > CLOCK_OFFSET_RESET_NS || error_ns < -CLOCK_OFFSET_RESET_NS) {
+        if (receiver_ptr->clock_offset_valid) {
+            blog(LOG_INFO, "CDI timestamps jumped by [%lld] ms, resetting clock offset.",
+                 (long long)(error_ns / 1000000));
+        }
+        receiver_ptr->clock_offset_ns = offset_ns;
+        receiver_ptr->clock_offset_valid = true;
+    } else {
+        receiver_ptr->clock_offset_ns += error_ns / CLOCK_OFFSET_SMOOTHING;
     }
 
-    return ret;
+    return ptp_ns + receiver_ptr->clock_offset_ns + jitter_ns;
 }
 
 /**
- * @brief Convert a CDI video frame to OBS.
- * 
- * @param cdi_ptr Pointer to CDI source data structure.
- * @param payload_ptr Pointer to CDI payload data.
- * @param payload_size Size of CDI payload in bytes.
- * @param timestamp CDI timestamp of the audio frame.
- * @param config_ptr Pointer to AVM CDI video configuration structure.
+ * Handle the CDI Rx AVM callback. Only queues the payload for the worker thread, so the receive buffer is not held up by
+ * the conversion.
+ *
+ * @param cb_data_ptr Pointer to Rx AVM callback data.
  */
-static void ProcessVideoFrame(cdi_source* cdi_ptr, uint8_t* payload_ptr, int payload_size, uint64_t timestamp, CdiAvmVideoConfig* config_ptr)
+static void TestAvmRxCallback(const CdiAvmRxCbData* cb_data_ptr)
 {
-    obs_source_frame* frame_ptr = &cdi_ptr->obs_video_frame;
+    cdi_receiver* receiver_ptr = (cdi_receiver*)cb_data_ptr->core_cb_data.user_cb_param;
 
-    frame_ptr->timestamp = timestamp;
-
-    frame_ptr->width = config_ptr->width;
-    frame_ptr->height = config_ptr->height;
-
-    video_colorspace colorspace = VIDEO_CS_709;
-    if (kCdiAvmVidColorimetryBT601 == config_ptr->colorimetry) {
-        colorspace = VIDEO_CS_601;
-    }
-    else if (kCdiAvmVidColorimetryBT2100 == config_ptr->colorimetry) {
-        colorspace = VIDEO_CS_2100_PQ;
-    }
+    // Counted before checking rx_stopping, so StopRxWorker() can wait for callbacks that did not see it.
+    receiver_ptr->rx_callbacks_active++;
 
-    video_range_type range = VIDEO_RANGE_FULL;
-    if (kCdiAvmVidRangeNarrow == config_ptr->range) {
-        range = VIDEO_RANGE_PARTIAL;
+    if (kCdiStatusOk != cb_data_ptr->core_cb_data.status_code) {
+        blog(LOG_ERROR, "Receive payload failed[%s].", CdiCoreStatusToString(cb_data_ptr->core_cb_data.status_code));
     }
+    else {
+        CdiOsAtomicInc32(&receiver_ptr->con_info.payload_received_count);
 
-    switch (config_ptr->sampling) {
-        case kCdiAvmVidYCbCr422:
-            if (!Cdi422ToObsVideoFrame(cdi_ptr, payload_ptr, payload_size, config_ptr)) {
-                return;
+        RxPayload* payload = receiver_ptr->rx_stopping ? nullptr : receiver_ptr->rx_queue.BeginPush();
+        if (nullptr == payload) {
+            if (!receiver_ptr->rx_stopping) {
+                receiver_ptr->rx_stats.dropped++;
             }
-            break;
-        case kCdiAvmVidYCbCr444:
-            if (!Cdi444ToObsVideoFrame(cdi_ptr, payload_ptr, payload_size, config_ptr)) {
-                return;
+            FreeRxBuffer(&cb_data_ptr->sgl);
+        } else {
+            payload->sgl = cb_data_ptr->sgl;
+            payload->has_config = (NULL != cb_data_ptr->config_ptr);
+            if (payload->has_config) {
+                payload->config = *cb_data_ptr->config_ptr;
             }
-            break;
-        case kCdiAvmVidRGB:
-            if (!CdiRgbToObsVideoFrame(cdi_ptr, payload_ptr, payload_size, config_ptr)) {
-                return;
+            payload->stream_identifier = cb_data_ptr->avm_extra_data.stream_identifier;
+
+            payload->receive_time_ns = os_gettime_ns();
+            payload->timestamp = MapPtpToObsTime(receiver_ptr,
+                &cb_data_ptr->core_cb_data.core_extra_data.origination_ptp_timestamp, payload->receive_time_ns);
+
+            receiver_ptr->rx_queue.EndPush();
+            os_sem_post(receiver_ptr->rx_sem);
+
+            receiver_ptr->rx_stats.queued++;
+            uint32_t depth = receiver_ptr->rx_queue.Depth();
+            if (depth > receiver_ptr->rx_stats.max_depth) {
+                receiver_ptr->rx_stats.max_depth = depth;
             }
-            colorspace = VIDEO_CS_SRGB;
-            break;
+        }
     }
 
-	video_format_get_parameters(colorspace, range, frame_ptr->color_matrix, frame_ptr->color_range_min, frame_ptr->color_range_max);
-
-	obs_source_output_video(cdi_ptr->obs_source, frame_ptr);
+    receiver_ptr->rx_callbacks_active--;
 }
 
 /**
- * @brief Convert a CDI audio frame to OBS.
- * 
- * @param cdi_ptr Pointer to CDI source data structure.
- * @param payload_ptr Pointer to CDI payload data.
- * @param payload_size Size of CDI payload in bytes.
- * @param timestamp CDI timestamp of the audio frame.
- * @param config_ptr Pointer to AVM CDI audio configuration structure.
+ * @brief Start the worker thread that processes received payloads.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ *
+ * @return true if successful, other false.
  */
-static void ProcessAudioFrame(cdi_source* cdi_ptr, void* payload_ptr, int payload_size, uint64_t timestamp, CdiAvmAudioConfig* config_ptr)
+static bool StartRxWorker(cdi_receiver* receiver_ptr)
 {
-	if (!cdi_ptr->config.audio_enabled) {
-		return;
-	}
-
-    obs_source_audio* frame_ptr = &cdi_ptr->obs_audio_frame;
-
-    if (config_ptr->sample_rate_khz == kCdiAvmAudioSampleRate48kHz) {
-        frame_ptr->samples_per_sec = 48000;
-    } else if (config_ptr->sample_rate_khz == kCdiAvmAudioSampleRate96kHz) {
-        frame_ptr->samples_per_sec = 96000;
-    }
-
-    int num_channels = 0;
-    frame_ptr->speakers = SPEAKERS_UNKNOWN;
-    // Grouping. Maps number of audio channels to audio grouping.
-    switch (config_ptr->grouping) {
-        case kCdiAvmAudioM: // Mono.
-            num_channels = 1;
-            frame_ptr->speakers = SPEAKERS_MONO;
-        break;
-        case kCdiAvmAudioST: // Standard Stereo (left, right).
-            num_channels = 2;
-            frame_ptr->speakers = SPEAKERS_STEREO;
-        break;
-        case kCdiAvmAudioSGRP: // One SDI audio group (1, 2, 3, 4).
-            num_channels = 4;
-            frame_ptr->speakers = SPEAKERS_4POINT0;
-        break;
-        case kCdiAvmAudio51: // 5.1 Surround (L, R, C, LFE, Ls, Rs).
-            num_channels = 6;
-            frame_ptr->speakers = SPEAKERS_5POINT1;
-        break;
-        case kCdiAvmAudio71: // Surround (L, R, C, LFE, Lss, Rss, Lrs, Rrs).
-            num_channels = 8;
-            frame_ptr->speakers = SPEAKERS_7POINT1;
-        break;
-        case kCdiAvmAudio222: // 22.2 Surround (SMPTE ST 2036-2, Table 1).
-            num_channels = 8; // 8 is the maximum number of channels that OBS supports.
-            frame_ptr->speakers = SPEAKERS_UNKNOWN;
-        break;
+    if (0 != os_sem_init(&receiver_ptr->rx_sem, 0)) {
+        receiver_ptr->rx_sem = nullptr;
+        return false;
     }
+    receiver_ptr->rx_stopping = false;
+    receiver_ptr->rx_worker_exit = false;
+    receiver_ptr->rx_worker_thread = std::thread(RxWorkerThread, receiver_ptr);
+    return true;
+}
 
-    frame_ptr->timestamp = timestamp;
-	frame_ptr->format = AUDIO_FORMAT_FLOAT_PLANAR;
-
-    int num_samples_per_channel = payload_size / CDI_BYTES_PER_AUDIO_SAMPLE / num_channels;
-    frame_ptr->frames = num_samples_per_channel;
-
-    // Validate CDI audio contains the correct number of 24-bit audio samples.
-    assert(payload_size <= num_channels * num_samples_per_channel * CDI_BYTES_PER_AUDIO_SAMPLE);
-
-    int ndi_audio_size = num_channels * num_samples_per_channel * sizeof(float);
-    (void)ndi_audio_size; // suppress compiler warning for release build.
+/**
+ * @brief Stop the worker thread, freeing all payloads still queued. Must be called before the connection is destroyed,
+ *        since the buffers of queued payloads belong to the connection.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ */
+static void StopRxWorker(cdi_receiver* receiver_ptr)
+{
+    // From now on the receive callback frees payloads itself. Wait for callbacks that may still be queuing.
+    receiver_ptr->rx_stopping = true;
+    while (0 != receiver_ptr->rx_callbacks_active) {
+        std::this_thread::yield();
+    }
 
-    // Validate that the NDI buffer is large enough to hold the NDI float audio samples.
-    assert(ndi_audio_size <= (int)sizeof(cdi_ptr->obs_audio_buffer));
+    if (receiver_ptr->rx_worker_thread.joinable()) {
+        receiver_ptr->rx_worker_exit = true;
+        os_sem_post(receiver_ptr->rx_sem);
+        receiver_ptr->rx_worker_thread.join();
+    }
+    if (receiver_ptr->rx_sem) {
+        os_sem_destroy(receiver_ptr->rx_sem);
+        receiver_ptr->rx_sem = nullptr;
+    }
 
-    uint8_t* ndi_audio_byte_ptr = cdi_ptr->obs_audio_buffer;
-    const uint8_t* cdi_audio_ptr = (uint8_t*)payload_ptr;
-    int obs_channel_stride_in_bytes = num_samples_per_channel * sizeof(float);
+    RxQueueStats* stats_ptr = &receiver_ptr->rx_stats;
+    blog(LOG_INFO, "Receive queue: [%llu] payloads queued, [%llu] dropped, max depth [%u].",
+         (unsigned long long)stats_ptr->queued.load(), (unsigned long long)stats_ptr->dropped.load(),
+         stats_ptr->max_depth.load());
+}
 
-    // For each channel, insert 24-bit int audio segment in correct spot of temp buffer.
-    for (int current_channel = 0; current_channel < num_channels; current_channel++) {
-        // Memory location of where to read CDI 24-bit int for this channel.
-        const uint8_t* interleaved_src_ptr = cdi_audio_ptr + (current_channel * CDI_BYTES_PER_AUDIO_SAMPLE);
-
-        // Memory location of where to write OBS 32-bit float for this channel.
-        float* channel_dest_ptr = (float*)(ndi_audio_byte_ptr + (current_channel * obs_channel_stride_in_bytes));
-
-        frame_ptr->data[current_channel] = (uint8_t*)channel_dest_ptr; // Set pointer the the start of the channel sample data in the OBS audio frame.
-
-        // For each channel sample, convert CDI 24-bit int to OBS 32-bit float and store in OBS audio buffer.
-        for (int current_sample = 0; current_sample < num_samples_per_channel; current_sample++) {
-            // Get 24-bit Big-Endian CDI sample and convert to 32-bit Little-Endian.
-            // Shift the 3 bytes to most significant position.
-            signed int scaled_signed_int = (interleaved_src_ptr[0] << 24) | (interleaved_src_ptr[1] << 16) |
-                                           (interleaved_src_ptr[2] << 8);
-            double scaled_double = (double)scaled_signed_int;
-            float sample_float = (float)(scaled_double / 0x7fffffff);
-            sample_float = (float)(MAX(-1.0, MIN(1.0, sample_float)));
-            *channel_dest_ptr = sample_float;
-
-            // Moves NDI audio memory location for next 32-bit float.
-            channel_dest_ptr++;
-
-            // Updates memory location of where to read next 24-bit CDI audio for channel.
-            // Updates by number of 3 byte channels in between current location and next interleaved location
-            // for same channel.
-            interleaved_src_ptr += num_channels * CDI_BYTES_PER_AUDIO_SAMPLE;
-        }
+/**
+ * @brief Create the AVM Rx connection, with a linear receive buffer sized for the current frame size and depth.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
+ *
+ * @return kCdiStatusOk if successful, otherwise the error.
+ */
+static CdiReturnStatus CreateRxConnection(cdi_receiver* receiver_ptr)
+{
+    CdiRxConfigData config_data = { 0 };
+    config_data.adapter_handle = receiver_ptr->con_info.adapter_handle;
+    config_data.dest_port = receiver_ptr->con_info.test_settings.dest_port;
+    if (receiver_ptr->con_info.test_settings.bind_ip_str && '\0' != receiver_ptr->con_info.test_settings.bind_ip_str[0]) {
+        // Only set bind_ip_addr_str if it contains a string.
+        config_data.bind_ip_addr_str = receiver_ptr->con_info.test_settings.bind_ip_str;
+    }
+    config_data.thread_core_num = -1; // -1= Let OS decide which CPU core to use.
+    if (receiver_ptr->con_info.test_settings.rx_sgl) {
+        // Payloads are handed over as the SDK's packet buffers, so no linear buffer is needed.
+        config_data.rx_buffer_type = kCdiSgl;
+        config_data.linear_buffer_size = 0;
+    } else {
+        config_data.rx_buffer_type = kCdiLinearBuffer;
+        config_data.linear_buffer_size = (uint64_t)receiver_ptr->rx_frame_size *
+                                         (receiver_ptr->con_info.test_settings.rx_depth + receiver_ptr->rx_hold_frames);
     }
+    config_data.user_cb_param = receiver_ptr;
+    config_data.connection_log_method_data_ptr = &log_method_data;
+    config_data.connection_cb_ptr = TestConnectionCallback;
+    config_data.connection_user_cb_param = receiver_ptr;
+    config_data.stats_config.disable_cloudwatch_stats = true;
 
-	obs_source_output_audio(cdi_ptr->obs_source, frame_ptr);
+
+    CdiReturnStatus rs = CdiAvmRxCreate(&config_data, TestAvmRxCallback, &receiver_ptr->con_info.connection_handle);
+    receiver_ptr->rx_buffer_bytes = (kCdiStatusOk == rs) ? config_data.linear_buffer_size : 0;
+    return rs;
 }
 
 /**
- * Handle the CDI Rx AVM callback.
+ * @brief Thread that recreates the Rx connection with a linear receive buffer sized for receiver_ptr->rx_frame_size. The
+ * adapter is kept, so this only takes as long as creating the connection.
  *
- * @param cb_data_ptr Pointer to Rx AVM callback data.
+ * @param receiver_ptr Pointer to CDI receiver data structure.
  */
-static void TestAvmRxCallback(const CdiAvmRxCbData* cb_data_ptr)
+static void ResizeRxThread(cdi_receiver* receiver_ptr)
 {
-    cdi_source* cdi_ptr = (cdi_source*)cb_data_ptr->core_cb_data.user_cb_param;
-
-    if (kCdiStatusOk != cb_data_ptr->core_cb_data.status_code) {
-        blog(LOG_ERROR, "Receive payload failed[%s].", CdiCoreStatusToString(cb_data_ptr->core_cb_data.status_code));
+    // Payloads still queued belong to the old connection, so they are freed before it is destroyed.
+    StopRxWorker(receiver_ptr);
+    if (receiver_ptr->con_info.connection_handle) {
+        CdiCoreConnectionDestroy(receiver_ptr->con_info.connection_handle);
+        receiver_ptr->con_info.connection_handle = nullptr;
     }
-    else {
-        CdiOsAtomicInc32(&cdi_ptr->con_info.payload_received_count);
-
-        CdiAvmBaselineConfig baseline_config;
-        if (NULL != cb_data_ptr->config_ptr) {
-            // Attempt to convert the generic configuration structure to a baseline profile configuration structure.
-            CdiReturnStatus rc = CdiAvmParseBaselineConfiguration(cb_data_ptr->config_ptr, &baseline_config);
-            if (kCdiStatusOk == rc) {
-                if (cb_data_ptr->sgl.sgl_head_ptr->next_ptr) {
-                    blog(LOG_ERROR, "CDI frame data not in linear format.");
-                }
-                else {
-                    uint64_t timestamp = cb_data_ptr->core_cb_data.core_extra_data.origination_ptp_timestamp.seconds * 1000000000 +
-                                         cb_data_ptr->core_cb_data.core_extra_data.origination_ptp_timestamp.nanoseconds;
-
-                    timestamp = timestamp * 100;
-                    //timestamp = os_gettime_ns();
-
-                    void* payload_ptr = cb_data_ptr->sgl.sgl_head_ptr->address_ptr;
-                    int payload_size = cb_data_ptr->sgl.total_data_size;
-                    int stream_identifier = cb_data_ptr->avm_extra_data.stream_identifier;
-
-                    if (kCdiAvmVideo == baseline_config.payload_type) {
-                        if (0 != memcmp(&cdi_ptr->video_config, &baseline_config.video_config, sizeof(cdi_ptr->video_config))) {
-                            blog(LOG_INFO, "CDI StreamID[%d] Video Payload Size[%d] AVM Data[%s]", stream_identifier,
-                                           payload_size, cb_data_ptr->config_ptr->data);
-                            memcpy(&cdi_ptr->video_config, &baseline_config.video_config, sizeof(cdi_ptr->video_config));
-                        }
-                        ProcessVideoFrame(cdi_ptr, (uint8_t*)payload_ptr, payload_size, timestamp, &baseline_config.video_config);
-                    }
-                    else if (kCdiAvmAudio == baseline_config.payload_type) {
-                        if (0 != memcmp(&cdi_ptr->audio_config, &baseline_config.audio_config, sizeof(cdi_ptr->audio_config))) {
-                            blog(LOG_INFO, "CDI StreamID[%d] Audio Payload Size[%d] AVM Data[%s]", stream_identifier,
-                                           payload_size, cb_data_ptr->config_ptr->data);
-                            memcpy(&cdi_ptr->audio_config, &baseline_config.audio_config, sizeof(cdi_ptr->audio_config));
-                        }
-                        ProcessAudioFrame(cdi_ptr, payload_ptr, payload_size, timestamp, &baseline_config.audio_config);
-                    }
-                }
-            }
-            else {
-                blog(LOG_ERROR, "Failed to parse baseline configuration [%s].", CdiCoreStatusToString(rc));
-            }
-        }
+    receiver_ptr->rx_buffer_bytes = 0;
 
-        CdiReturnStatus rs = CdiCoreRxFreeBuffer(&cb_data_ptr->sgl);
+    if (!StartRxWorker(receiver_ptr)) {
+        blog(LOG_ERROR, "Failed to restart the receive worker thread.");
+    } else {
+        CdiReturnStatus rs = CreateRxConnection(receiver_ptr);
         if (kCdiStatusOk != rs) {
-            blog(LOG_ERROR, "CdiCoreRxFreeBuffer failed[%s].", CdiCoreStatusToString(rs));
+            blog(LOG_ERROR, "Failed to recreate CDI connection [%s].", CdiCoreStatusToString(rs));
         }
     }
+
+    std::lock_guard<std::mutex> lock(receiver_ptr->rx_resize_mutex);
+    receiver_ptr->rx_resize_pending = false;
 }
 
 /**
- * @brief Create a CDI source.
- * 
- * @param cdi_ptr Pointer to CDI source data structure.
+ * @brief Create a CDI receiver: register the adapter, start the worker thread and create the connection.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure, with its settings filled in.
  *
  * @return true if successful, other false.
  */
-static bool SourceCreate(cdi_source* cdi_ptr)
+static bool ReceiverCreate(cdi_receiver* receiver_ptr)
 {
     // Setup default test settings.
-    cdi_ptr->con_info.test_settings.protocol_type = kProtocolTypeAvm;
-    cdi_ptr->con_info.test_settings.payload_size = 0;
+    receiver_ptr->con_info.test_settings.protocol_type = kProtocolTypeAvm;
+    receiver_ptr->con_info.test_settings.payload_size = 0;
 
-    blog(LOG_INFO, "Initializing source.");
+    blog(LOG_INFO, "Initializing receiver.");
 
-    CdiOsSignalCreate(&cdi_ptr->con_info.connection_state_change_signal);
+    CdiOsSignalCreate(&receiver_ptr->con_info.connection_state_change_signal);
 
     //-----------------------------------------------------------------------------------------------------------------
     // CDI SDK Step 1: Initialize CDI core (must do before initializing adapter or creating connections).
     //-----------------------------------------------------------------------------------------------------------------
     CdiReturnStatus rs = kCdiStatusOk;
-    // See logic in obs_module_load();
+    // Done by the first NetworkAdapterInitialize().
 
     //-----------------------------------------------------------------------------------------------------------------
 	// CDI SDK Step 2: Register the EFA adapter.
 	//-----------------------------------------------------------------------------------------------------------------
-    CdiAdapterHandle adapter_handle = NetworkAdapterInitialize(cdi_ptr->con_info.test_settings.local_adapter_ip_str, nullptr);
-    if (nullptr == adapter_handle) {
+    // Receive only, so no Tx buffer is needed.
+    receiver_ptr->con_info.adapter_handle =
+        NetworkAdapterInitialize(receiver_ptr->con_info.test_settings.local_adapter_ip_str, 0, nullptr);
+    if (nullptr == receiver_ptr->con_info.adapter_handle) {
+        rs = kCdiStatusFatal;
+    }
+
+    // Payloads can be received as soon as the connection exists, so the worker must already be running.
+    if (kCdiStatusOk == rs && !StartRxWorker(receiver_ptr)) {
         rs = kCdiStatusFatal;
     }
 
@@ -875,60 +1821,200 @@ static bool SourceCreate(cdi_source* cdi_ptr)
     // CDI SDK Step 3. Create a AVM Rx connection.
     //-----------------------------------------------------------------------------------------------------------------
     if (kCdiStatusOk == rs) {
-        CdiRxConfigData config_data = { 0 };
-        config_data.adapter_handle = adapter_handle;
-        config_data.dest_port = cdi_ptr->con_info.test_settings.dest_port;
-        if (cdi_ptr->con_info.test_settings.bind_ip_str && '\0' != cdi_ptr->con_info.test_settings.bind_ip_str[0]) {
-            // Only set bind_ip_addr_str if it contains a string.
-            config_data.bind_ip_addr_str = cdi_ptr->con_info.test_settings.bind_ip_str;
-        }
-        config_data.thread_core_num = -1; // -1= Let OS decide which CPU core to use.
-        config_data.rx_buffer_type = kCdiLinearBuffer;
-        config_data.linear_buffer_size = LINEAR_RX_BUFFER_SIZE;
-        config_data.user_cb_param = cdi_ptr;
-        config_data.connection_log_method_data_ptr = &log_method_data;
-        config_data.connection_cb_ptr = TestConnectionCallback;
-        config_data.connection_user_cb_param = cdi_ptr;
-        config_data.stats_config.disable_cloudwatch_stats = true;
+        rs = CreateRxConnection(receiver_ptr);
+    }
+
+    if (kCdiStatusOk != rs) {
+        StopRxWorker(receiver_ptr);
 
-        rs = CdiAvmRxCreate(&config_data, TestAvmRxCallback, &cdi_ptr->con_info.connection_handle);
+        // Do not keep the adapter referenced by a receiver that failed to be created.
+        if (receiver_ptr->con_info.adapter_handle) {
+            NetworkAdapterDestroy(receiver_ptr->con_info.adapter_handle);
+            receiver_ptr->con_info.adapter_handle = nullptr;
+        }
+        CdiOsSignalDelete(receiver_ptr->con_info.connection_state_change_signal);
     }
 
     return kCdiStatusOk == rs;
 }
 
 /**
- * @brief Called by OBS to destroy a source.
- * 
- * @param data Pointer to CDI source data structure.
+ * @brief Destroy a CDI receiver once its last source is gone.
+ *
+ * @param receiver_ptr Pointer to CDI receiver data structure.
  */
-void cdi_source_destroy(void* data)
+static void ReceiverDestroy(cdi_receiver* receiver_ptr)
 {
-    cdi_source* cdi_ptr = (cdi_source*)data;
+    // Wait for a resize in progress, and make sure no other one starts.
+    {
+        std::lock_guard<std::mutex> lock(receiver_ptr->rx_resize_mutex);
+        receiver_ptr->rx_resize_blocked = true;
+    }
+    if (receiver_ptr->rx_resize_thread.joinable()) {
+        receiver_ptr->rx_resize_thread.join();
+    }
+
+    // Queued payloads must be freed while their connection still exists.
+    StopRxWorker(receiver_ptr);
 
     //-----------------------------------------------------------------------------------------------------------------
     // CDI SDK Step 6. Shutdown and clean-up CDI SDK resources.
     //-----------------------------------------------------------------------------------------------------------------
-    if (cdi_ptr->con_info.connection_handle) {
-        CdiCoreConnectionDestroy(cdi_ptr->con_info.connection_handle);
-        cdi_ptr->con_info.connection_handle = nullptr;
+    if (receiver_ptr->con_info.connection_handle) {
+        CdiCoreConnectionDestroy(receiver_ptr->con_info.connection_handle);
+        receiver_ptr->con_info.connection_handle = nullptr;
     }
     
-    NetworkAdapterDestroy();
+    if (receiver_ptr->con_info.adapter_handle) {
+        NetworkAdapterDestroy(receiver_ptr->con_info.adapter_handle);
+        receiver_ptr->con_info.adapter_handle = nullptr;
+    }
 
     // CdiCoreShutdown() is invoked in obs_module_unload();
 
     // Clean-up additional resources used by this application.
-    CdiOsSignalDelete(cdi_ptr->con_info.connection_state_change_signal);
+    CdiOsSignalDelete(receiver_ptr->con_info.connection_state_change_signal);
+
+    delete receiver_ptr; // Allocated using C++ new.
+}
+
+/**
+ * @brief Add a source to the receiver of its connection, creating the receiver if the source is its first user.
+ *
+ * @param cdi_ptr Pointer to CDI source data structure.
+ *
+ * @return true if successful, other false.
+ */
+static bool SourceCreate(cdi_source* cdi_ptr)
+{
+    std::lock_guard<std::mutex> guard(receiver_mutex);
+
+    std::string key = cdi_ptr->local_ip_str + "|" + cdi_ptr->bind_ip_str + "|" + std::to_string(cdi_ptr->port);
+    cdi_receiver* receiver_ptr = nullptr;
+    auto it = receiver_map.find(key);
+    if (it != receiver_map.end()) {
+        receiver_ptr = it->second;
+        blog(LOG_INFO, "Sharing the receiver of port [%d] with [%d] other sources.", cdi_ptr->port,
+             receiver_ptr->ref_count);
+    } else {
+        receiver_ptr = new cdi_receiver; // Contains C++ objects, so cannot use bzalloc().
+        receiver_ptr->key = key;
+        receiver_ptr->local_ip_str = cdi_ptr->local_ip_str;
+        receiver_ptr->bind_ip_str = cdi_ptr->bind_ip_str;
+        TestSettings* settings_ptr = &receiver_ptr->con_info.test_settings;
+        settings_ptr->local_adapter_ip_str = receiver_ptr->local_ip_str.c_str();
+        settings_ptr->bind_ip_str = receiver_ptr->bind_ip_str.c_str();
+        settings_ptr->dest_port = cdi_ptr->port;
+        settings_ptr->rx_sgl = cdi_ptr->rx_sgl;
+        settings_ptr->rx_depth = cdi_ptr->rx_depth;
+        receiver_ptr->rx_jitter_ns = cdi_ptr->jitter_ns;
+
+        if (!ReceiverCreate(receiver_ptr)) {
+            delete receiver_ptr;
+            return false;
+        }
+        receiver_map[key] = receiver_ptr;
+    }
 
-    if (cdi_ptr->conv_buffer) {
-        delete cdi_ptr->conv_buffer;
-        cdi_ptr->conv_buffer = nullptr;
+    std::lock_guard<std::mutex> lock(receiver_ptr->source_mutex);
+    receiver_ptr->sources.push_back(cdi_ptr);
+    receiver_ptr->ref_count++;
+    cdi_ptr->receiver_ptr = receiver_ptr;
+    UpdateReceiverSources(receiver_ptr);
+
+    return true;
+}
+
+/**
+ * @brief Called by OBS to destroy a source.
+ * 
+ * @param data Pointer to CDI source data structure.
+ */
+void cdi_source_destroy(void* data)
+{
+    cdi_source* cdi_ptr = (cdi_source*)data;
+    cdi_receiver* receiver_ptr = cdi_ptr->receiver_ptr;
+
+    // Once removed from its receiver, the worker thread no longer uses the source.
+    {
+        std::lock_guard<std::mutex> guard(receiver_mutex);
+        {
+            std::lock_guard<std::mutex> lock(receiver_ptr->source_mutex);
+            auto& sources = receiver_ptr->sources;
+            sources.erase(std::remove(sources.begin(), sources.end(), cdi_ptr), sources.end());
+            UpdateReceiverSources(receiver_ptr);
+        }
+        if (0 == --receiver_ptr->ref_count) {
+            receiver_map.erase(receiver_ptr->key);
+            ReceiverDestroy(receiver_ptr);
+        }
     }
 
     delete cdi_ptr; // Allocated using C++ new.
 }
 
+/**
+ * @brief Called by OBS when the button that creates sources for the other streams of the connection is clicked.
+ * Each video stream that no source shows gets a source that shows it, added to the current scene.
+ *
+ * @param data Pointer to CDI source data structure.
+ *
+ * @return false, the properties do not change.
+ */
+static bool CreateStreamSources(obs_properties_t*, obs_property_t*, void* data)
+{
+    cdi_source* cdi_ptr = (cdi_source*)data;
+    cdi_receiver* receiver_ptr = cdi_ptr->receiver_ptr;
+
+    std::vector<int> stream_ids;
+    {
+        std::lock_guard<std::mutex> lock(receiver_ptr->source_mutex);
+        for (const RxStreamInfo& info : receiver_ptr->video_streams) {
+            bool shown = false;
+            for (cdi_source* source_ptr : receiver_ptr->sources) {
+                shown = shown || (source_ptr->video_stream == info.stream_identifier);
+            }
+            if (!shown) {
+                stream_ids.push_back(info.stream_identifier);
+            }
+        }
+    }
+
+    obs_source_t* scene_source = obs_frontend_get_current_scene();
+    obs_scene_t* scene = obs_scene_from_source(scene_source);
+    if (nullptr == scene) {
+        blog(LOG_WARNING, "No current scene to add the stream sources to.");
+        obs_source_release(scene_source);
+        return false;
+    }
+
+    obs_data_t* settings = obs_source_get_settings(cdi_ptr->obs_source);
+    for (int stream_id : stream_ids) {
+        QByteArray name = QString("%1 (stream %2)").arg(obs_source_get_name(cdi_ptr->obs_source)).arg(stream_id)
+                              .toUtf8();
+        obs_source_t* existing = obs_get_source_by_name(name.constData());
+        if (existing) {
+            obs_source_release(existing);
+            continue;
+        }
+
+        obs_data_t* stream_settings = obs_data_create();
+        obs_data_apply(stream_settings, settings);
+        obs_data_set_int(stream_settings, PROP_VIDEO_STREAM_ID, stream_id);
+        obs_data_set_int(stream_settings, PROP_AUDIO_STREAM_ID, STREAM_ID_AUTO);
+        obs_source_t* stream_source = obs_source_create("cdi_source", name.constData(), stream_settings, nullptr);
+        if (stream_source) {
+            obs_scene_add(scene, stream_source);
+            obs_source_release(stream_source);
+        }
+        obs_data_release(stream_settings);
+    }
+    obs_data_release(settings);
+    obs_source_release(scene_source);
+
+    return false;
+}
+
 /**
  * @brief Called by OBS to get the name of the source.
  * 
@@ -944,17 +2030,110 @@ const char* cdi_source_getname(void*)
  * 
  * @return Pointer to new properties object.
  */
-obs_properties_t* cdi_source_getproperties(void*)
+obs_properties_t* cdi_source_getproperties(void* data)
 {
+    cdi_source* cdi_ptr = (cdi_source*)data;
+
     obs_properties_t* props = obs_properties_create();
 
     obs_properties_add_text(props, PROP_LOCAL_IP, obs_module_text("CDIPlugin.SourceProps.LocalIP"), OBS_TEXT_DEFAULT);
     obs_properties_add_text(props, PROP_LOCAL_BIND_IP, obs_module_text("CDIPlugin.SourceProps.LocalBindIP"), OBS_TEXT_DEFAULT);
     obs_properties_add_text(props, PROP_PORT, obs_module_text("CDIPlugin.SourceProps.Port"), OBS_TEXT_DEFAULT);
-	obs_properties_add_bool(props, PROP_AUDIO, obs_module_text("CDIPlugin.SourceProps.Audio"));
+    obs_property_t* media_type = obs_properties_add_list(props, PROP_MEDIA_TYPE,
+        obs_module_text("CDIPlugin.SourceProps.MediaType"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(media_type, obs_module_text("CDIPlugin.SourceProps.MediaAudioVideo"),
+                              MEDIA_AUDIO_VIDEO);
+    obs_property_list_add_int(media_type, obs_module_text("CDIPlugin.SourceProps.MediaAudioOnly"), MEDIA_AUDIO_ONLY);
+    obs_property_list_add_int(media_type, obs_module_text("CDIPlugin.SourceProps.MediaVideoOnly"), MEDIA_VIDEO_ONLY);
+    obs_properties_add_bool(props, PROP_RX_SGL, obs_module_text("CDIPlugin.SourceProps.RxSgl"));
+    obs_properties_add_int(props, PROP_RX_DEPTH, obs_module_text("CDIPlugin.SourceProps.RxDepth"), 2,
+                           MAX_RX_DEPTH_FRAMES, 1);
+    obs_properties_add_int(props, PROP_JITTER_MS, obs_module_text("CDIPlugin.SourceProps.JitterBuffer"), 0,
+                           MAX_JITTER_BUFFER_MS, 1);
+
+    obs_property_t* audio_block = obs_properties_add_list(props, PROP_AUDIO_BLOCK,
+        obs_module_text("CDIPlugin.SourceProps.AudioBlock"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(audio_block, obs_module_text("CDIPlugin.SourceProps.AudioBlockOff"), 0);
+    obs_property_list_add_int(audio_block, "5 ms", 5);
+    obs_property_list_add_int(audio_block, "10 ms", 10);
+    obs_property_list_add_int(audio_block, "1024 samples", AUDIO_BLOCK_OBS_TICK);
+
+    obs_property_t* audio_downmix = obs_properties_add_list(props, PROP_AUDIO_DOWNMIX,
+        obs_module_text("CDIPlugin.SourceProps.AudioDownmix"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(audio_downmix, "7.1", 8);
+    obs_property_list_add_int(audio_downmix, "5.1", 6);
+    obs_property_list_add_int(audio_downmix, "Stereo", 2);
+
+    obs_properties_add_int(props, PROP_VIDEO_STREAM_ID, obs_module_text("CDIPlugin.SourceProps.VideoStreamId"),
+                           STREAM_ID_AUTO, 65535, 1);
+    obs_properties_add_int(props, PROP_AUDIO_STREAM_ID, obs_module_text("CDIPlugin.SourceProps.AudioStreamId"),
+                           STREAM_ID_AUTO, 65535, 1);
+
+    obs_property_t* video_scale = obs_properties_add_list(props, PROP_VIDEO_SCALE,
+        obs_module_text("CDIPlugin.SourceProps.VideoScale"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(video_scale, obs_module_text("CDIPlugin.SourceProps.VideoScaleFull"), 1);
+    obs_property_list_add_int(video_scale, "1/2", 2);
+    obs_property_list_add_int(video_scale, "1/4", 4);
+    obs_properties_add_int(props, PROP_VIDEO_FRAME_INTERVAL,
+                           obs_module_text("CDIPlugin.SourceProps.VideoFrameInterval"), 1, MAX_VIDEO_FRAME_INTERVAL, 1);
+    obs_properties_add_bool(props, PROP_HIDDEN_AUDIO, obs_module_text("CDIPlugin.SourceProps.HiddenAudio"));
+    obs_properties_add_bool(props, PROP_HIDDEN_RELEASE, obs_module_text("CDIPlugin.SourceProps.HiddenRelease"));
 
     obs_properties_add_text(props, "Information", "OBS CDI plugin " OBS_CDI_VERSION "\n"
-        "Supports all CDI progressive sources. Audio supports up to 8 channels.", OBS_TEXT_INFO);
+        "Supports all CDI progressive sources. Audio supports all CDI groupings, downmixed to at most 8 channels.",
+        OBS_TEXT_INFO);
+
+    if (cdi_ptr) {
+        obs_properties_add_button(props, "create_stream_sources",
+                                  obs_module_text("CDIPlugin.SourceProps.CreateStreamSources"), CreateStreamSources);
+
+        // Snapshot of the receive queue counters, taken when the properties are opened.
+        cdi_receiver* receiver_ptr = cdi_ptr->receiver_ptr;
+        RxQueueStats* stats_ptr = &receiver_ptr->rx_stats;
+        uint64_t processed = stats_ptr->processed;
+        double latency_avg_ms = processed ? (double)stats_ptr->latency_sum_ns / processed / 1000000.0 : 0.0;
+        char stats_str[1024];
+        snprintf(stats_str, sizeof(stats_str), "Receive queue: depth %u (max %u of %d), %llu queued, %llu dropped\n"
+                 "Receive queue latency: average %.2f ms, max %.2f ms", receiver_ptr->rx_queue.Depth(),
+                 stats_ptr->max_depth.load(), RX_QUEUE_SIZE, (unsigned long long)stats_ptr->queued.load(),
+                 (unsigned long long)stats_ptr->dropped.load(), latency_avg_ms,
+                 stats_ptr->latency_max_ns / 1000000.0);
+        size_t length = strlen(stats_str);
+        snprintf(stats_str + length, sizeof(stats_str) - length, "\nVideo frames dropped to catch up: %llu",
+                 (unsigned long long)stats_ptr->video_behind.load());
+        length = strlen(stats_str);
+        snprintf(stats_str + length, sizeof(stats_str) - length,
+                 "\nMemory: receive buffer %.1f MB, conversion %.1f MB, audio %.1f KB",
+                 receiver_ptr->rx_buffer_bytes / (1024.0 * 1024.0), receiver_ptr->conv_buffer_bytes / (1024.0 * 1024.0),
+                 cdi_ptr->audio_buffer_bytes / 1024.0);
+        length = strlen(stats_str);
+        snprintf(stats_str + length, sizeof(stats_str) - length,
+                 "\nJitter buffer: %llu ms, output %.1f ms after arrival on average, %llu payloads late",
+                 (unsigned long long)(receiver_ptr->rx_jitter_ns / 1000000), stats_ptr->hold_avg_ns / 1000000.0,
+                 (unsigned long long)stats_ptr->late.load());
+        length = strlen(stats_str);
+        snprintf(stats_str + length, sizeof(stats_str) - length,
+                 "\nAudio clock: %+.1f ppm correction, %llu timeline resets, %llu blocks output",
+                 cdi_ptr->audio_drift_ppm.load(), (unsigned long long)cdi_ptr->audio_drift_resets.load(),
+                 (unsigned long long)cdi_ptr->audio_outputs.load());
+        {
+            // The streams of the connection, with the ones this source shows marked.
+            std::lock_guard<std::mutex> lock(receiver_ptr->source_mutex);
+            for (int type = 0; type < 2; type++) {
+                const std::vector<RxStreamInfo>& streams = type ? receiver_ptr->audio_streams :
+                                                                  receiver_ptr->video_streams;
+                int shown = type ? cdi_ptr->audio_stream : cdi_ptr->video_stream;
+                length = strlen(stats_str);
+                snprintf(stats_str + length, sizeof(stats_str) - length, "%s", type ? ", audio" : "\nStreams: video");
+                for (const RxStreamInfo& info : streams) {
+                    length = strlen(stats_str);
+                    snprintf(stats_str + length, sizeof(stats_str) - length, " %d%s", info.stream_identifier,
+                             (info.stream_identifier == shown) ? "*" : "");
+                }
+            }
+        }
+        obs_properties_add_text(props, "Statistics", stats_str, OBS_TEXT_INFO);
+    }
 
     return props;
 }
@@ -971,6 +2150,18 @@ void cdi_source_getdefaults(obs_data_t *settings)
     obs_data_set_default_string(settings, PROP_LOCAL_BIND_IP, "");
     obs_data_set_default_string(settings, PROP_PORT, "5000");
     obs_data_set_default_bool(settings, PROP_AUDIO, true);
+    obs_data_set_default_int(settings, PROP_MEDIA_TYPE, MEDIA_AUDIO_VIDEO);
+    obs_data_set_default_bool(settings, PROP_RX_SGL, false);
+    obs_data_set_default_int(settings, PROP_RX_DEPTH, DEFAULT_RX_DEPTH_FRAMES);
+    obs_data_set_default_int(settings, PROP_JITTER_MS, 0);
+    obs_data_set_default_int(settings, PROP_AUDIO_BLOCK, DEFAULT_AUDIO_BLOCK_MS);
+    obs_data_set_default_int(settings, PROP_AUDIO_DOWNMIX, MAX_AV_PLANES);
+    obs_data_set_default_int(settings, PROP_VIDEO_STREAM_ID, STREAM_ID_AUTO);
+    obs_data_set_default_int(settings, PROP_AUDIO_STREAM_ID, STREAM_ID_AUTO);
+    obs_data_set_default_int(settings, PROP_VIDEO_SCALE, 1);
+    obs_data_set_default_int(settings, PROP_VIDEO_FRAME_INTERVAL, 1);
+    obs_data_set_default_bool(settings, PROP_HIDDEN_AUDIO, true);
+    obs_data_set_default_bool(settings, PROP_HIDDEN_RELEASE, false);
 }
 
 /**
@@ -986,12 +2177,56 @@ void cdi_source_update(void *data, obs_data_t *settings)
 	auto name = obs_source_get_name(obs_source);
     (void)name;
 
-    cdi_ptr->con_info.test_settings.local_adapter_ip_str = obs_data_get_string(settings, PROP_LOCAL_IP);
-    cdi_ptr->con_info.test_settings.bind_ip_str = obs_data_get_string(settings, PROP_LOCAL_BIND_IP);
-    cdi_ptr->con_info.test_settings.dest_port = atoi(obs_data_get_string(settings, PROP_PORT));
-	cdi_ptr->config.audio_enabled = obs_data_get_bool(settings, PROP_AUDIO);
+    cdi_ptr->local_ip_str = obs_data_get_string(settings, PROP_LOCAL_IP);
+    cdi_ptr->bind_ip_str = obs_data_get_string(settings, PROP_LOCAL_BIND_IP);
+    cdi_ptr->port = atoi(obs_data_get_string(settings, PROP_PORT));
+    cdi_ptr->rx_sgl = obs_data_get_bool(settings, PROP_RX_SGL);
+    cdi_ptr->rx_depth = (int)obs_data_get_int(settings, PROP_RX_DEPTH);
+
+    // Sources saved before the media type setting existed only had the audio checkbox.
+    int media = (int)obs_data_get_int(settings, PROP_MEDIA_TYPE);
+    if (!obs_data_has_user_value(settings, PROP_MEDIA_TYPE) && !obs_data_get_bool(settings, PROP_AUDIO)) {
+        media = MEDIA_VIDEO_ONLY;
+    }
+	cdi_ptr->config.audio_enabled = (MEDIA_VIDEO_ONLY != media);
 	obs_source_set_audio_active(obs_source, cdi_ptr->config.audio_enabled);
 
+    // Applied to the next payloads received, including which streams the source shows. The linear receive buffer grows
+    // to hold the frames of the jitter buffer at the next video frame.
+    {
+        cdi_receiver* receiver_ptr = cdi_ptr->receiver_ptr;
+        std::unique_lock<std::mutex> lock;
+        if (receiver_ptr) {
+            lock = std::unique_lock<std::mutex>(receiver_ptr->source_mutex);
+        }
+        cdi_ptr->jitter_ns = (uint64_t)obs_data_get_int(settings, PROP_JITTER_MS) * 1000000;
+        cdi_ptr->video_stream_setting = (int)obs_data_get_int(settings, PROP_VIDEO_STREAM_ID);
+        cdi_ptr->audio_stream_setting = (int)obs_data_get_int(settings, PROP_AUDIO_STREAM_ID);
+        int scale = (int)obs_data_get_int(settings, PROP_VIDEO_SCALE);
+        cdi_ptr->video_scale = 0;
+        for (int i = 0; i < VIDEO_SCALE_COUNT; i++) {
+            if (video_scales[i] == scale) {
+                cdi_ptr->video_scale = i;
+            }
+        }
+        cdi_ptr->video_frame_interval = (std::max)(1, (int)obs_data_get_int(settings, PROP_VIDEO_FRAME_INTERVAL));
+
+        // The worker thread only outputs video while holding source_mutex, so no frame follows the one clearing it.
+        bool video_enabled = (MEDIA_AUDIO_ONLY != media);
+        if (!video_enabled && cdi_ptr->config.video_enabled) {
+            obs_source_output_video(obs_source, nullptr);
+        }
+        cdi_ptr->config.video_enabled = video_enabled;
+        if (receiver_ptr) {
+            UpdateReceiverSources(receiver_ptr);
+        }
+    }
+    cdi_ptr->audio_block_setting = (int)obs_data_get_int(settings, PROP_AUDIO_BLOCK);
+    cdi_ptr->audio_downmix_setting = (int)obs_data_get_int(settings, PROP_AUDIO_DOWNMIX);
+    cdi_ptr->hidden_audio = obs_data_get_bool(settings, PROP_HIDDEN_AUDIO);
+    cdi_ptr->hidden_release = obs_data_get_bool(settings, PROP_HIDDEN_RELEASE);
+
+    // Payloads are output at their presentation time by the jitter buffer, so OBS must show them right away.
     obs_source_set_async_unbuffered(obs_source, true);
 }
 
@@ -1019,6 +2254,32 @@ void cdi_source_deactivated(void *data)
     (void)name;
 }
 
+/**
+ * @brief Called by OBS when a source is shown anywhere: in the program, the preview, a projector or the multiview.
+ * Video conversion resumes with the next frame received.
+ * 
+ * @param data Pointer to CDI source data structure.
+ */
+void cdi_source_shown(void *data)
+{
+    cdi_source* cdi_ptr = (cdi_source*)data;
+    cdi_ptr->shown = true;
+    blog(LOG_DEBUG, "Source [%s] shown, converting its video.", obs_source_get_name(cdi_ptr->obs_source));
+}
+
+/**
+ * @brief Called by OBS when a source is no longer shown anywhere. Its video is no longer converted, though its
+ * payloads are still received and freed.
+ * 
+ * @param data Pointer to CDI source data structure.
+ */
+void cdi_source_hidden(void *data)
+{
+    cdi_source* cdi_ptr = (cdi_source*)data;
+    cdi_ptr->shown = false;
+    blog(LOG_DEBUG, "Source [%s] hidden, no longer converting its video.", obs_source_get_name(cdi_ptr->obs_source));
+}
+
 /**
  * @brief Called by OBS when a source is renamed.
  * 
@@ -1051,15 +2312,9 @@ void *cdi_source_create(obs_data_t *settings, obs_source_t *obs_source)
 	auto sh = obs_source_get_signal_handler(cdi_ptr->obs_source);
 	signal_handler_connect(sh, "rename", cdi_source_renamed, cdi_ptr);
 
-    // Temporary buffer for converting CDI -> OBS.
-    cdi_ptr->conv_buffer = new uint8_t[MAX_VIDEO_FRAME_SIZE];
-
     cdi_source_update(cdi_ptr, settings);
 
     if (!SourceCreate(cdi_ptr)) {
-        if (cdi_ptr->conv_buffer) {
-            delete cdi_ptr->conv_buffer;
-        }
         delete cdi_ptr;
         cdi_ptr = nullptr;
     }
@@ -1077,7 +2332,8 @@ obs_source_info create_cdi_source_info()
 	obs_source_info cdi_source_info = {};
 	cdi_source_info.id = "cdi_source";
 	cdi_source_info.type = OBS_SOURCE_TYPE_INPUT;
-	cdi_source_info.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO | OBS_SOURCE_DO_NOT_DUPLICATE;
+	// Duplicates share the receiver of the original, so they cost no more than another subscriber of its streams.
+	cdi_source_info.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO;
 
 	cdi_source_info.get_name = cdi_source_getname;
 	cdi_source_info.get_properties = cdi_source_getproperties;
@@ -1087,6 +2343,8 @@ obs_source_info create_cdi_source_info()
 	cdi_source_info.activate = cdi_source_activated;
 	cdi_source_info.update = cdi_source_update;
 	cdi_source_info.deactivate = cdi_source_deactivated;
+	cdi_source_info.show = cdi_source_shown;
+	cdi_source_info.hide = cdi_source_hidden;
 	cdi_source_info.destroy = cdi_source_destroy;
 
 	return cdi_source_info;
@@ -17,7 +17,16 @@
 */
 
 #include <sys/stat.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <map>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <obs-module.h>
 #include <obs-frontend-api.h>
@@ -48,45 +57,469 @@ QLibrary* loaded_lib = nullptr;
 OutputSettings* output_settings;
 CdiLogMethodData log_method_data;
 
+/**
+ * @brief A network adapter that has been initialized for a local IP address, shared by all the sources and outputs
+ * that use that address.
+ */
+struct NetworkAdapter {
+	std::string ip_str;               ///< Local IP address of the adapter. adapter_data points at this string.
+	CdiAdapterData adapter_data{};    ///< Adapter data used to initialize the adapter.
+	CdiAdapterHandle handle{nullptr}; ///< Handle of the initialized adapter.
+	int ref_count{0};                 ///< Number of sources and outputs using the adapter.
+	/// @brief When the last user released the adapter. Only meaningful while ref_count is zero.
+	std::chrono::steady_clock::time_point idle_since;
+
+	/// @brief Free regions of the adapter's Tx buffer, as offset -> size. Adjacent regions are always merged.
+	std::map<size_t, size_t> tx_buffer_free_map;
+	/// @brief Regions of the Tx buffer handed out by TxBufferAlloc(), as offset -> size.
+	std::map<size_t, size_t> tx_buffer_used_map;
+};
+
 static std::mutex adapter_mutex;
-static volatile int adapter_ref_count = 0;
-static CdiAdapterHandle adapter_handle = nullptr;
-static CdiAdapterData adapter_data{};
+/// @brief Initialized adapters, keyed by local IP address. Entries are only removed when their last user is gone.
+static std::map<std::string, NetworkAdapter> adapter_map;
+/// @brief Used to rotate between equally loaded adapters when a list of local IP addresses is given.
+static unsigned int adapter_round_robin = 0;
+
+/// @brief Size of the Tx buffer an adapter registers for its outputs, in bytes. The outputs of the address share it.
+static uint64_t adapter_tx_buffer_bytes = (uint64_t)DEFAULT_ADAPTER_TX_BUFFER_MB * 1024 * 1024;
+
+/// @brief Number of outputs configured for each local IP address. An adapter first initialized by a source of such an
+/// address still registers a Tx buffer, so the outputs can share the adapter later.
+static std::map<std::string, int> output_address_map;
+
+/// @brief Seconds an unused adapter stays initialized. -1 keeps it until the module is unloaded, 0 destroys it as soon
+/// as its last user is gone.
+static int adapter_idle_timeout_sec = DEFAULT_ADAPTER_IDLE_TIMEOUT_SEC;
+static std::thread adapter_reaper_thread;          ///< Destroys adapters that have been idle for too long.
+static std::condition_variable adapter_reaper_cv;  ///< Wakes up the reaper thread. Used with adapter_mutex.
+static bool adapter_reaper_exit = false;           ///< Tells the reaper thread to exit.
+static bool core_initialized = false;              ///< true once CdiCoreInitialize() succeeded. Uses adapter_mutex.
+
+/**
+ * @brief Initialize the CDI core, if not already done. Must be called with adapter_mutex held.
+ *
+ * @return true if the CDI core is initialized.
+ */
+static bool CoreInitialize()
+{
+	if (core_initialized) {
+		return true;
+	}
+
+	CdiCoreConfigData core_config;
+	core_config.default_log_level = kLogDebug;
+	core_config.global_log_method_data_ptr = &log_method_data;
+	core_config.cloudwatch_config_ptr = NULL; //Don't use cloudwatch for this. This can be changed later if someone wants to have the
+	                                          // payloads tracked in CloudWatch.
+
+	// Init CDI with the core config we just built.
+	CdiReturnStatus rs = CdiCoreInitialize(&core_config);
+	blog(LOG_INFO, "CdiCoreInitialize: %d", rs);
+	core_initialized = (kCdiStatusOk == rs);
+
+	return core_initialized;
+}
+
+/**
+ * @brief Find the adapter that owns a handle. Must be called with adapter_mutex held.
+ *
+ * @param handle Handle of the adapter.
+ *
+ * @return Pointer to the adapter, or nullptr if the handle is not known.
+ */
+static NetworkAdapter* FindAdapter(CdiAdapterHandle handle)
+{
+	if (nullptr == handle) {
+		return nullptr;
+	}
+	for (auto& entry : adapter_map) {
+		if (entry.second.handle == handle) {
+			return &entry.second;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * @brief Destroy an adapter and remove it from the registry. Must be called with adapter_mutex held.
+ *
+ * @param adapter_ptr Pointer to the adapter. It is no longer valid after this call.
+ */
+static void DestroyAdapter(NetworkAdapter* adapter_ptr)
+{
+	if (!adapter_ptr->tx_buffer_used_map.empty()) {
+		blog(LOG_WARNING, "Destroying adapter [%s] with [%d] Tx buffer regions still allocated.",
+			adapter_ptr->ip_str.c_str(), (int)adapter_ptr->tx_buffer_used_map.size());
+	}
+	blog(LOG_INFO, "Destroying adapter for local IP: %s", adapter_ptr->ip_str.c_str());
+	CdiCoreNetworkAdapterDestroy(adapter_ptr->handle);
+	adapter_map.erase(adapter_ptr->ip_str);
+}
+
+/**
+ * @brief Take a region from the Tx buffer of an adapter. Must be called with adapter_mutex held.
+ *
+ * @param adapter_ptr Pointer to the adapter.
+ * @param size_bytes Size of the region. It is rounded up to TX_BUFFER_ALIGNMENT.
+ *
+ * @return Pointer to the region, or nullptr if it does not fit in the free space of the Tx buffer.
+ */
+static void* TxBufferAlloc(NetworkAdapter* adapter_ptr, size_t size_bytes)
+{
+	// Keep every region page aligned, so payloads of one connection never share a page with another connection.
+	size_bytes = (size_bytes + TX_BUFFER_ALIGNMENT - 1) & ~(size_t)(TX_BUFFER_ALIGNMENT - 1);
+
+	// First fit. There are only a handful of connections per adapter, so the free list stays tiny.
+	auto& free_map = adapter_ptr->tx_buffer_free_map;
+	for (auto it = free_map.begin(); it != free_map.end(); ++it) {
+		if (it->second >= size_bytes) {
+			size_t offset = it->first;
+			size_t remaining = it->second - size_bytes;
+			free_map.erase(it);
+			if (remaining) {
+				free_map[offset + size_bytes] = remaining;
+			}
+			adapter_ptr->tx_buffer_used_map[offset] = size_bytes;
+			return (uint8_t*)adapter_ptr->adapter_data.ret_tx_buffer_ptr + offset;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * @brief Thread that destroys adapters once they have been unused for adapter_idle_timeout_sec seconds.
+ */
+static void AdapterReaperThread()
+{
+	std::unique_lock<std::mutex> lock(adapter_mutex);
+
+	while (!adapter_reaper_exit) {
+		auto now = std::chrono::steady_clock::now();
+		auto next_deadline = (std::chrono::steady_clock::time_point::max)();
+		auto timeout = std::chrono::seconds(adapter_idle_timeout_sec);
+
+		for (auto it = adapter_map.begin(); it != adapter_map.end();) {
+			NetworkAdapter& adapter = (it++)->second; // Advance first, DestroyAdapter() erases the entry.
+			if (0 != adapter.ref_count || adapter_idle_timeout_sec < 0) {
+				continue;
+			}
+			auto deadline = adapter.idle_since + timeout;
+			if (deadline <= now) {
+				DestroyAdapter(&adapter);
+			} else {
+				next_deadline = (std::min)(next_deadline, deadline);
+			}
+		}
+
+		if ((std::chrono::steady_clock::time_point::max)() == next_deadline) {
+			adapter_reaper_cv.wait(lock);
+		} else {
+			adapter_reaper_cv.wait_until(lock, next_deadline);
+		}
+	}
+}
+
+/**
+ * @brief Split a comma separated list of local IP addresses. Whitespace around the addresses is ignored.
+ *
+ * @param ip_list_str The list of addresses.
+ *
+ * @return The non-empty addresses in the list.
+ */
+static std::vector<std::string> SplitIpList(const char* ip_list_str)
+{
+	std::vector<std::string> ip_list;
+	std::string list = ip_list_str ? ip_list_str : "";
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		if (std::string::npos == comma) {
+			comma = list.size();
+		}
+		std::string ip = list.substr(pos, comma - pos);
+		size_t first = ip.find_first_not_of(" \t");
+		size_t last = ip.find_last_not_of(" \t");
+		if (std::string::npos != first) {
+			ip_list.push_back(ip.substr(first, last - first + 1));
+		}
+		pos = comma + 1;
+	}
+	return ip_list;
+}
 
-CdiAdapterHandle NetworkAdapterInitialize(const char* local_adapter_ip_str, void** ret_tx_buffer_ptr)
+/**
+ * @brief Get a reference to the adapter for a local IP address, initializing the adapter if this is its first user,
+ * and take the caller's part of its Tx buffer. Each distinct local IP address gets its own adapter. Its Tx buffer is
+ * registered once, sized by NetworkAdapterSetTxBufferSize(), and shared by the outputs of the address.
+ *
+ * @param local_adapter_ip_str Local IP address of the adapter, or a comma separated list of addresses to let the
+ *                             least used adapter of the list be picked.
+ * @param tx_buffer_bytes Bytes the caller needs from the adapter's Tx buffer, or 0 for receive-only users. An
+ *                        adapter initialized by a receive-only user does not register a Tx buffer, unless an output
+ *                        is configured for the address. See NetworkAdapterAddOutputAddress().
+ * @param ret_tx_buffer_pptr Address where to write the pointer to the caller's part of the Tx buffer. Free it using
+ *                           NetworkAdapterTxBufferFree(). May be nullptr if tx_buffer_bytes is 0.
+ *
+ * @return Handle of the adapter, or nullptr on error. Release it using NetworkAdapterDestroy().
+ */
+CdiAdapterHandle NetworkAdapterInitialize(const char* local_adapter_ip_str, size_t tx_buffer_bytes,
+	void** ret_tx_buffer_pptr)
 {
 	std::lock_guard<std::mutex> guard(adapter_mutex);
 
-	if (0 == adapter_ref_count) {
-		adapter_data.adapter_ip_addr_str = local_adapter_ip_str;
-        adapter_data.tx_buffer_size_bytes = MAX_PAYLOAD_SIZE * MAX_NUMBER_OF_TX_PAYLOADS;
-		adapter_data.adapter_type = kCdiAdapterTypeEfa;
+	std::vector<std::string> ip_list = SplitIpList(local_adapter_ip_str);
+	if (ip_list.empty()) {
+		blog(LOG_ERROR, "No local adapter IP address specified.");
+		return nullptr;
+	}
+
+	// With more than one address, spread the load by picking the adapter that has the fewest users. Adapters that
+	// are equally loaded are picked in turn.
+	size_t selected = 0;
+	if (ip_list.size() > 1) {
+		size_t start = adapter_round_robin++ % ip_list.size();
+		int lowest_ref_count = INT_MAX;
+		for (size_t i = 0; i < ip_list.size(); i++) {
+			size_t index = (start + i) % ip_list.size();
+			auto it = adapter_map.find(ip_list[index]);
+			int ref_count = (it == adapter_map.end()) ? 0 : it->second.ref_count;
+			if (ref_count < lowest_ref_count) {
+				lowest_ref_count = ref_count;
+				selected = index;
+			}
+		}
+	}
+
+	// The CDI core must be initialized before initializing adapters or creating connections.
+	if (!CoreInitialize()) {
+		return nullptr;
+	}
+
+	void* tx_buffer_ptr = nullptr;
+	auto it = adapter_map.find(ip_list[selected]);
+	if (it != adapter_map.end() && tx_buffer_bytes) {
+		NetworkAdapter& adapter = it->second;
+		tx_buffer_ptr = TxBufferAlloc(&adapter, tx_buffer_bytes);
+		if (nullptr == tx_buffer_ptr) {
+			// The Tx buffer can only be registered again with a larger size while nobody uses the adapter.
+			if (adapter.ref_count) {
+				uint64_t used_bytes = 0;
+				for (const auto& region : adapter.tx_buffer_used_map) {
+					used_bytes += region.second;
+				}
+				if (0 == adapter.adapter_data.tx_buffer_size_bytes) {
+					blog(LOG_ERROR, "Adapter [%s] was initialized by sources without a Tx buffer. Stop the sources "
+						"using the address, or create the output before them.", adapter.ip_str.c_str());
+					return nullptr;
+				}
+				blog(LOG_ERROR, "Tx buffer of adapter [%s] is full: [%zu] bytes needed, [%llu] of [%llu] bytes taken "
+					"by [%d] outputs. Raise AdapterTxBufferMB, or stop the sources and outputs using the address so "
+					"its adapter is initialized again.", adapter.ip_str.c_str(), tx_buffer_bytes,
+					(unsigned long long)used_bytes, (unsigned long long)adapter.adapter_data.tx_buffer_size_bytes,
+					(int)adapter.tx_buffer_used_map.size());
+				return nullptr;
+			}
+			DestroyAdapter(&adapter);
+		}
+	}
 
-        blog(LOG_INFO, "Local IP: %s", local_adapter_ip_str);
-		if (kCdiStatusOk != CdiCoreNetworkAdapterInitialize(&adapter_data, &adapter_handle)) {
+	NetworkAdapter& adapter = adapter_map[ip_list[selected]];
+	if (nullptr == adapter.handle) {
+		// An output that needs more than the configured size gets a Tx buffer that fits it.
+		uint64_t tx_size_bytes = 0;
+		if (tx_buffer_bytes || output_address_map.count(ip_list[selected])) {
+			tx_size_bytes = (std::max)(adapter_tx_buffer_bytes, (uint64_t)tx_buffer_bytes);
+			tx_size_bytes = (tx_size_bytes + TX_BUFFER_ALIGNMENT - 1) & ~(uint64_t)(TX_BUFFER_ALIGNMENT - 1);
+		}
+		adapter.ip_str = ip_list[selected];
+		adapter.adapter_data.adapter_ip_addr_str = adapter.ip_str.c_str();
+		adapter.adapter_data.tx_buffer_size_bytes = tx_size_bytes;
+		adapter.adapter_data.adapter_type = kCdiAdapterTypeEfa;
+
+		blog(LOG_INFO, "Initializing adapter for local IP: %s with a Tx buffer of [%llu] bytes", adapter.ip_str.c_str(),
+			(unsigned long long)tx_size_bytes);
+		if (kCdiStatusOk != CdiCoreNetworkAdapterInitialize(&adapter.adapter_data, &adapter.handle)) {
+			blog(LOG_ERROR, "Unable to initialize adapter for local IP [%s] with a Tx buffer of [%llu] bytes.",
+				adapter.ip_str.c_str(), (unsigned long long)tx_size_bytes);
+			adapter_map.erase(ip_list[selected]);
 			return nullptr;
 		}
+		adapter.tx_buffer_free_map.clear();
+		adapter.tx_buffer_used_map.clear();
+		if (tx_size_bytes) {
+			adapter.tx_buffer_free_map[0] = tx_size_bytes;
+			tx_buffer_ptr = TxBufferAlloc(&adapter, tx_buffer_bytes);
+		}
+	} else if (0 == adapter.ref_count) {
+		blog(LOG_INFO, "Reusing idle adapter for local IP: %s", adapter.ip_str.c_str());
+	} else if (ip_list.size() > 1) {
+		blog(LOG_INFO, "Using adapter for local IP: %s", adapter.ip_str.c_str());
+	}
+	adapter.ref_count++;
+
+	if (ret_tx_buffer_pptr) {
+		*ret_tx_buffer_pptr = tx_buffer_ptr;
+	}
+	return adapter.handle;
+}
+
+void NetworkAdapterDestroy(CdiAdapterHandle handle)
+{
+	std::lock_guard<std::mutex> guard(adapter_mutex);
+
+	NetworkAdapter* adapter_ptr = FindAdapter(handle);
+	assert(adapter_ptr && 0 != adapter_ptr->ref_count);
+	if (nullptr == adapter_ptr) {
+		return;
+	}
+
+	if (0 != --adapter_ptr->ref_count) {
+		return;
+	}
+
+	// Initializing an adapter and registering its Tx buffer takes seconds, so keep unused adapters around for a
+	// while. Restarting an output or changing its settings then reuses the adapter.
+	if (0 == adapter_idle_timeout_sec) {
+		DestroyAdapter(adapter_ptr);
+		return;
+	}
+	adapter_ptr->idle_since = std::chrono::steady_clock::now();
+	if (adapter_idle_timeout_sec > 0) {
+		if (!adapter_reaper_thread.joinable()) {
+			adapter_reaper_exit = false;
+			adapter_reaper_thread = std::thread(AdapterReaperThread);
+		}
+		adapter_reaper_cv.notify_one();
+	}
+}
+
+/**
+ * @brief Set how long adapters stay initialized after their last user is gone.
+ *
+ * @param seconds Idle time in seconds. -1 keeps adapters until the module is unloaded, 0 destroys them right away.
+ */
+void NetworkAdapterSetIdleTimeout(int seconds)
+{
+	std::lock_guard<std::mutex> guard(adapter_mutex);
+
+	adapter_idle_timeout_sec = MAX(seconds, -1);
+	blog(LOG_INFO, "Adapter idle timeout: %d seconds", adapter_idle_timeout_sec);
+
+	// Let the reaper apply the new timeout to adapters that are already idle.
+	if (adapter_idle_timeout_sec >= 0 && !adapter_reaper_thread.joinable()) {
+		adapter_reaper_exit = false;
+		adapter_reaper_thread = std::thread(AdapterReaperThread);
+	}
+	adapter_reaper_cv.notify_one();
+}
+
+/**
+ * @brief Set the size of the Tx buffer that adapters register for their outputs. Adapters that are already initialized
+ * keep their size until they are initialized again.
+ *
+ * @param megabytes Size in MiB. 0 or less uses DEFAULT_ADAPTER_TX_BUFFER_MB.
+ */
+void NetworkAdapterSetTxBufferSize(int megabytes)
+{
+	std::lock_guard<std::mutex> guard(adapter_mutex);
+
+	if (megabytes <= 0) {
+		megabytes = DEFAULT_ADAPTER_TX_BUFFER_MB;
+	}
+	adapter_tx_buffer_bytes = (uint64_t)megabytes * 1024 * 1024;
+	blog(LOG_INFO, "Adapter Tx buffer size: %d MiB", megabytes);
+}
+
+/**
+ * @brief Record that an output is configured for local IP addresses, so their adapters register a Tx buffer even when
+ * a source initializes them first. The Tx buffer cannot be added once the adapter is in use.
+ *
+ * @param local_adapter_ip_str Local IP address of the output, or a comma separated list of addresses.
+ */
+void NetworkAdapterAddOutputAddress(const char* local_adapter_ip_str)
+{
+	std::lock_guard<std::mutex> guard(adapter_mutex);
+
+	for (const std::string& ip : SplitIpList(local_adapter_ip_str)) {
+		output_address_map[ip]++;
+	}
+}
+
+/**
+ * @brief Undo NetworkAdapterAddOutputAddress().
+ *
+ * @param local_adapter_ip_str The addresses given to NetworkAdapterAddOutputAddress().
+ */
+void NetworkAdapterRemoveOutputAddress(const char* local_adapter_ip_str)
+{
+	std::lock_guard<std::mutex> guard(adapter_mutex);
+
+	for (const std::string& ip : SplitIpList(local_adapter_ip_str)) {
+		auto it = output_address_map.find(ip);
+		if (it != output_address_map.end() && 0 == --it->second) {
+			output_address_map.erase(it);
+		}
 	}
-	adapter_ref_count++;
+}
 
-	if (ret_tx_buffer_ptr) {
-		*ret_tx_buffer_ptr = adapter_data.ret_tx_buffer_ptr;
+/**
+ * @brief Destroy all the adapters, including ones that are still in use. Called when the module is unloaded.
+ */
+void NetworkAdapterDestroyAll(void)
+{
+	{
+		std::lock_guard<std::mutex> guard(adapter_mutex);
+		adapter_reaper_exit = true;
+		adapter_reaper_cv.notify_one();
+	}
+	if (adapter_reaper_thread.joinable()) {
+		adapter_reaper_thread.join();
 	}
 
-	return adapter_handle;
+	std::lock_guard<std::mutex> guard(adapter_mutex);
+	while (!adapter_map.empty()) {
+		NetworkAdapter& adapter = adapter_map.begin()->second;
+		if (adapter.ref_count) {
+			blog(LOG_WARNING, "Adapter [%s] still has [%d] users.", adapter.ip_str.c_str(), adapter.ref_count);
+		}
+		DestroyAdapter(&adapter);
+	}
 }
 
-void NetworkAdapterDestroy(void)
+void NetworkAdapterTxBufferFree(CdiAdapterHandle handle, void* buffer_ptr)
 {
 	std::lock_guard<std::mutex> guard(adapter_mutex);
 
-	assert(0 != adapter_ref_count);
-	if (1 == adapter_ref_count) {
-        CdiCoreNetworkAdapterDestroy(adapter_handle);
-		adapter_handle = nullptr;
-		memset(&adapter_data, 0, sizeof(adapter_data));
+	NetworkAdapter* adapter_ptr = FindAdapter(handle);
+	if (nullptr == buffer_ptr || nullptr == adapter_ptr) {
+		return;
+	}
+
+	size_t offset = (size_t)((uint8_t*)buffer_ptr - (uint8_t*)adapter_ptr->adapter_data.ret_tx_buffer_ptr);
+	auto used_it = adapter_ptr->tx_buffer_used_map.find(offset);
+	if (used_it == adapter_ptr->tx_buffer_used_map.end()) {
+		blog(LOG_ERROR, "Attempt to free unknown Tx buffer region [%p].", buffer_ptr);
+		return;
+	}
+	size_t size_bytes = used_it->second;
+	adapter_ptr->tx_buffer_used_map.erase(used_it);
+
+	// Insert the region back into the free list, merging it with its neighbors.
+	auto& free_map = adapter_ptr->tx_buffer_free_map;
+	auto next_it = free_map.lower_bound(offset);
+	if (next_it != free_map.end() && offset + size_bytes == next_it->first) {
+		size_bytes += next_it->second;
+		next_it = free_map.erase(next_it);
+	}
+	if (next_it != free_map.begin()) {
+		auto prev_it = std::prev(next_it);
+		if (prev_it->first + prev_it->second == offset) {
+			prev_it->second += size_bytes;
+			return;
+		}
 	}
-	adapter_ref_count--;
+	free_map[offset] = size_bytes;
 }
 
 void TestConsoleLogMessageCallback(const CdiLogMessageCbData* cb_data_ptr)
@@ -128,23 +561,16 @@ bool obs_module_load(void)
     log_method_data.callback_data.log_msg_cb_ptr = TestConsoleLogMessageCallback;
     log_method_data.callback_data.log_user_cb_param = NULL;
 
-    CdiCoreConfigData core_config;
-    core_config.default_log_level = kLogDebug;
-    core_config.global_log_method_data_ptr = &log_method_data;
-    core_config.cloudwatch_config_ptr = NULL; //Don't use cloudwatch for this. This can be changed later if someone wants to have the
-                                              // payloads tracked in CloudWatch.
-
-    // Init CDI with the core config we just built.
-    CdiReturnStatus rs = CdiCoreInitialize(&core_config);
-    blog(LOG_INFO, "CdiCoreInitialize: %d", rs);
-	if (kCdiStatusOk != rs) {
-		return false;
-	}
+	// The CDI core is initialized by the first NetworkAdapterInitialize(), so OBS does not pay for it unless a CDI
+	// source or output is used.
 
 	if (main_window) {
 		Config* conf = Config::Current();
 		conf->Load();
 
+		NetworkAdapterSetIdleTimeout(conf->AdapterIdleTimeoutSec);
+		NetworkAdapterSetTxBufferSize(conf->AdapterTxBufferMB);
+
 		main_output_init(conf->OutputName.toUtf8().constData());
 
 		// Ui setup
@@ -181,7 +607,13 @@ bool obs_module_load(void)
 
 void obs_module_unload(void)
 {
-	CdiCoreShutdown();
+	NetworkAdapterDestroyAll();
+
+	std::lock_guard<std::mutex> guard(adapter_mutex);
+	if (core_initialized) {
+		CdiCoreShutdown();
+		core_initialized = false;
+	}
 }
 
 const char* obs_module_name()
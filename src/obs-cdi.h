@@ -31,6 +31,25 @@ extern "C" {
 #define CDI_MAX_SIMULTANEOUS_TX_PAYLOADS_PER_CONNECTION (8)
 #define MAX_NUMBER_OF_TX_PAYLOADS				(CDI_MAX_SIMULTANEOUS_TX_PAYLOADS_PER_CONNECTION + 1)
 
+/// @brief Default size in MiB of the Tx buffer an adapter registers for its outputs. Room for two worst case
+/// (MAX_PAYLOAD_SIZE) outputs, or more of smaller formats.
+#define DEFAULT_ADAPTER_TX_BUFFER_MB    (256)
+/// @brief Alignment of the regions handed out from the adapter Tx buffer.
+#define TX_BUFFER_ALIGNMENT             (4096)
+/// @brief Default number of seconds an adapter stays initialized after its last user is gone.
+#define DEFAULT_ADAPTER_IDLE_TIMEOUT_SEC (300)
+
+/// @brief Keys of the cdi_output settings. Every output instance is configured through its own obs_data.
+#define OUTPUT_PROP_NAME            "cdi_name"
+#define OUTPUT_PROP_LOCAL_IP        "local_ip"
+#define OUTPUT_PROP_DEST_IP         "dest_ip"
+#define OUTPUT_PROP_DEST_PORT       "dest_port"
+#define OUTPUT_PROP_VIDEO_STREAM_ID "video_stream_id"
+#define OUTPUT_PROP_AUDIO_STREAM_ID "audio_stream_id"
+#define OUTPUT_PROP_VIDEO_SAMPLING  "video_sampling"
+#define OUTPUT_PROP_ALPHA_USED      "alpha_used"
+#define OUTPUT_PROP_BIT_DEPTH       "bit_depth"
+
 #define blog(level, msg, ...) blog(level, "[obs-cdi] " msg, ##__VA_ARGS__)
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
@@ -42,11 +61,19 @@ extern obs_source_info create_cdi_source_info();
 extern struct obs_output_info create_cdi_output_info();
 
 void main_output_start(const char* output_name);
+void main_output_update(const char* output_name);
 void main_output_stop();
 bool main_output_is_running();
 
-CdiAdapterHandle NetworkAdapterInitialize(const char* local_adapter_ip_str, void** ret_tx_buffer_ptr);
-void NetworkAdapterDestroy(void);
+CdiAdapterHandle NetworkAdapterInitialize(const char* local_adapter_ip_str, size_t tx_buffer_bytes,
+                                          void** ret_tx_buffer_pptr);
+void NetworkAdapterDestroy(CdiAdapterHandle handle);
+void NetworkAdapterTxBufferFree(CdiAdapterHandle handle, void* buffer_ptr);
+void NetworkAdapterSetIdleTimeout(int seconds);
+void NetworkAdapterSetTxBufferSize(int megabytes);
+void NetworkAdapterAddOutputAddress(const char* local_adapter_ip_str);
+void NetworkAdapterRemoveOutputAddress(const char* local_adapter_ip_str);
+void NetworkAdapterDestroyAll(void);
 
 void TestConsoleLogMessageCallback(const CdiLogMessageCbData* cb_data_ptr);
 };
@@ -99,9 +99,10 @@ void OutputSettings::onFormAccepted() {
 
 	if (conf->OutputEnabled) {
 		if (main_output_is_running()) {
-			main_output_stop();
+			main_output_update(ui->mainOutputName->text().toUtf8().constData());
+		} else {
+			main_output_start(ui->mainOutputName->text().toUtf8().constData());
 		}
-		main_output_start(ui->mainOutputName->text().toUtf8().constData());
 	} else {
 		main_output_stop();
 	}